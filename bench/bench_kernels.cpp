@@ -0,0 +1,305 @@
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "Philox.h"
+#include "SpatialGrid.h"
+#include "Sphere.h"
+#include "SphereStore.h"
+#include "config.h"
+#include "vec3.h"
+
+/**
+ * Microbenchmarks of the narrow and broad phase on their own, away from the
+ * event queue: collide, resolve_collision, Sphere::update_position and its
+ * sphere store counterpart advance_sphere, get_cell_index and
+ * get_nearby_spheres. the store and grid ones run for every scalar type,
+ * the Sphere ones in long double. pairs of spheres come head on, grazing or
+ * missing. prints a table and writes the results as JSON.
+ *
+ *   bench_kernels [--min-time 0.2] [--spheres 10000] [--seed 1]
+ *                 [--json bench_kernels.json]
+ */
+
+namespace {
+
+constexpr int Dim = DIMENSIONS;
+constexpr int POOL = 1024; // inputs cycled through, so no call sees the same
+constexpr double RADIUS = 0.01;
+constexpr double GAP = 0.05; // distance between the centers of a pair
+
+struct Row {
+  std::string function;
+  std::string scalar;
+  std::string distribution;
+  long calls;
+  double ns_per_call;
+  double bytes_per_call; // sphere state the call reads or writes
+};
+
+struct Options {
+  double min_time = 0.2;
+  int spheres = 10000;
+  std::uint64_t seed = 1;
+};
+
+volatile double sink;
+
+/**
+ * calls f(k) for k cycling through [0, POOL) until min_time has passed and
+ * returns the time per call in nanoseconds.
+ */
+template <typename F> double time_calls(double min_time, long &calls, F &&f) {
+  using clock = std::chrono::steady_clock;
+  for (int k = 0; k < POOL; k++) {
+    f(k);
+  }
+
+  calls = 0;
+  auto start = clock::now();
+  double elapsed;
+  do {
+    for (int k = 0; k < POOL; k++) {
+      f(k);
+    }
+    calls += POOL;
+    elapsed = std::chrono::duration<double>(clock::now() - start).count();
+  } while (elapsed < min_time);
+  return elapsed * 1e9 / calls;
+}
+
+struct Approach {
+  const char *name;
+  double impact; // offset from the line of centers, in diameters
+};
+
+const Approach approaches[] = {
+    {"head_on", 0.0}, {"grazing", 0.95}, {"miss", 1.5}};
+
+/**
+ * pair k of a pool: the first sphere moves straight at the second one, which
+ * is at rest, offset from its path by impact diameters. directions are drawn
+ * from seed, so every scalar type gets the same pairs.
+ */
+void draw_pair(std::uint64_t seed, int k, double impact,
+               basic_point3<double, Dim> &c1, basic_vec3<double, Dim> &v1,
+               basic_point3<double, Dim> &c2) {
+  basic_point3<double, Dim> unused;
+  basic_vec3<double, Dim> side;
+  draw_sphere<double, Dim>(seed, 2 * k, unused, v1);
+  draw_sphere<double, Dim>(seed, 2 * k + 1, unused, side);
+  side -= side.dot(v1) * v1;
+  side.normalize();
+
+  c1.setConstant(0.5);
+  c2 = c1 + GAP * v1 + impact * 2 * RADIUS * side;
+}
+
+template <typename Scalar>
+BasicSphereStore<Scalar, Dim> make_pairs(std::uint64_t seed, double impact) {
+  BasicSphereStore<Scalar, Dim> store(2 * POOL, RADIUS, TORUS_SIZE);
+  for (int k = 0; k < POOL; k++) {
+    basic_point3<double, Dim> c1, c2;
+    basic_vec3<double, Dim> v1;
+    draw_pair(seed, k, impact, c1, v1, c2);
+    store.set_center(2 * k, c1.cast<Scalar>());
+    store.set_velocity(2 * k, v1.cast<Scalar>());
+    store.set_center(2 * k + 1, c2.cast<Scalar>());
+  }
+  return store;
+}
+
+std::vector<Sphere> make_sphere_pairs(std::uint64_t seed, double impact) {
+  std::vector<Sphere> spheres(2 * POOL);
+  for (int k = 0; k < POOL; k++) {
+    basic_point3<double, Dim> c1, c2;
+    basic_vec3<double, Dim> v1;
+    draw_pair(seed, k, impact, c1, v1, c2);
+    spheres[2 * k] =
+        Sphere(RADIUS, c1.cast<long double>(), v1.cast<long double>());
+    spheres[2 * k + 1] =
+        Sphere(RADIUS, c2.cast<long double>(), vec3::Zero());
+  }
+  return spheres;
+}
+
+template <typename Scalar>
+void bench_scalar(const char *scalar, const Options &options,
+                  std::vector<Row> &rows) {
+  // center, velocity and clock of one sphere
+  double state_bytes = (2 * Dim + 1) * sizeof(Scalar);
+  long calls;
+
+  for (const Approach &approach : approaches) {
+    BasicSphereStore<Scalar, Dim> store =
+        make_pairs<Scalar>(options.seed, approach.impact);
+    double ns = time_calls(options.min_time, calls, [&](int k) {
+      sink = collide(store, 2 * k, 2 * k + 1);
+    });
+    rows.push_back({"collide", scalar, approach.name, calls, ns,
+                    2 * state_bytes});
+  }
+
+  // a miss has nothing to resolve
+  for (const Approach &approach : approaches) {
+    if (approach.impact >= 1) {
+      continue;
+    }
+    BasicSphereStore<Scalar, Dim> store =
+        make_pairs<Scalar>(options.seed, approach.impact);
+    double ns = time_calls(options.min_time, calls, [&](int k) {
+      resolve_collision(store, 2 * k, 2 * k + 1);
+    });
+    sink = store.velocity(0, 0);
+    rows.push_back({"resolve_collision", scalar, approach.name, calls, ns,
+                    2 * (state_bytes + sizeof(int))});
+  }
+
+  // spheres at the density run_simulation uses for this many of them
+  double epsilon = std::pow(options.spheres, -1.0 / (Dim - 1));
+  int grid_size = (int)(TORUS_SIZE / epsilon);
+  BasicSpatialGrid<Scalar, Dim> grid(TORUS_SIZE / (Scalar)grid_size, grid_size,
+                                     options.spheres, epsilon / 2,
+                                     options.seed, 1);
+
+  Scalar t = 0;
+  double ns = time_calls(options.min_time, calls, [&](int k) {
+    t += (Scalar)1e-6;
+    grid.advance_sphere(k % options.spheres, t);
+  });
+  rows.push_back(
+      {"advance_sphere", scalar, "uniform", calls, ns, state_bytes});
+
+  std::vector<basic_point3<Scalar, Dim>> points(POOL);
+  for (int k = 0; k < POOL; k++) {
+    basic_vec3<Scalar, Dim> unused;
+    draw_sphere<Scalar, Dim>(options.seed + 1, k, points[k], unused);
+  }
+  ns = time_calls(options.min_time, calls, [&](int k) {
+    sink = (double)grid.get_cell_index(points[k]);
+  });
+  rows.push_back({"get_cell_index", scalar, "uniform", calls, ns,
+                  Dim * sizeof(Scalar)});
+
+  long found = 0, queries = 0;
+  ns = time_calls(options.min_time, calls, [&](int k) {
+    found += (long)grid.get_nearby_spheres(k % options.spheres).size();
+    queries++;
+  });
+  // the indices handed back
+  rows.push_back({"get_nearby_spheres", scalar, "uniform", calls, ns,
+                  (double)found / queries * sizeof(int)});
+}
+
+void bench_sphere(const Options &options, std::vector<Row> &rows) {
+  double bytes = sizeof(Sphere);
+  long calls;
+
+  for (const Approach &approach : approaches) {
+    std::vector<Sphere> spheres =
+        make_sphere_pairs(options.seed, approach.impact);
+    double ns = time_calls(options.min_time, calls, [&](int k) {
+      sink = collide(&spheres[2 * k], &spheres[2 * k + 1]);
+    });
+    rows.push_back({"Sphere collide", "long double", approach.name, calls, ns,
+                    2 * bytes});
+  }
+
+  for (const Approach &approach : approaches) {
+    if (approach.impact >= 1) {
+      continue;
+    }
+    std::vector<Sphere> spheres =
+        make_sphere_pairs(options.seed, approach.impact);
+    double ns = time_calls(options.min_time, calls, [&](int k) {
+      resolve_collision(&spheres[2 * k], &spheres[2 * k + 1]);
+    });
+    sink = (double)spheres[0].get_velocity()[0];
+    rows.push_back({"Sphere resolve_collision", "long double", approach.name,
+                    calls, ns, 2 * bytes});
+  }
+
+  std::vector<Sphere> spheres = make_sphere_pairs(options.seed, 0);
+  double ns = time_calls(options.min_time, calls, [&](int k) {
+    spheres[2 * k].update_position(1e-6);
+  });
+  sink = (double)spheres[0].get_center()[0];
+  rows.push_back({"Sphere update_position", "long double", "uniform", calls,
+                  ns, bytes});
+}
+
+void write_json(std::ostream &out, const std::vector<Row> &rows) {
+  out << "{\n  \"dimensions\": " << Dim << ",\n  \"results\": [";
+  for (size_t i = 0; i < rows.size(); i++) {
+    const Row &r = rows[i];
+    out << (i == 0 ? "\n" : ",\n") << "    {\"function\": \"" << r.function
+        << "\", \"scalar\": \"" << r.scalar << "\", \"distribution\": \""
+        << r.distribution << "\", \"calls\": " << r.calls
+        << ", \"ns_per_call\": " << r.ns_per_call
+        << ", \"calls_per_second\": " << 1e9 / r.ns_per_call
+        << ", \"bytes_per_call\": " << r.bytes_per_call
+        << ", \"bytes_per_second\": " << r.bytes_per_call * 1e9 / r.ns_per_call
+        << "}";
+  }
+  out << "\n  ]\n}\n";
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  Options options;
+  std::string json = "bench_kernels.json";
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--help" || i + 1 >= argc) {
+      std::cout << "usage: " << argv[0]
+                << " [--min-time 0.2] [--spheres 10000] [--seed 1]"
+                   " [--json file]"
+                << std::endl;
+      return arg == "--help" ? 0 : 1;
+    }
+    std::string value = argv[++i];
+    if (arg == "--min-time") {
+      options.min_time = std::stod(value);
+    } else if (arg == "--spheres") {
+      options.spheres = std::stoi(value);
+    } else if (arg == "--seed") {
+      options.seed = std::stoull(value);
+    } else if (arg == "--json") {
+      json = value;
+    } else {
+      std::cerr << "unknown option " << arg << std::endl;
+      return 1;
+    }
+  }
+
+  std::vector<Row> rows;
+  bench_scalar<float>("float", options, rows);
+  bench_scalar<double>("double", options, rows);
+  bench_scalar<long double>("long double", options, rows);
+  bench_sphere(options, rows);
+
+  std::printf("%-26s %-12s %-8s %10s %14s %10s %10s\n", "function", "scalar",
+              "input", "ns/call", "calls/s", "B/call", "GB/s");
+  for (const Row &r : rows) {
+    std::printf("%-26s %-12s %-8s %10.2f %14.0f %10.1f %10.2f\n",
+                r.function.c_str(), r.scalar.c_str(), r.distribution.c_str(),
+                r.ns_per_call, 1e9 / r.ns_per_call, r.bytes_per_call,
+                r.bytes_per_call / r.ns_per_call);
+  }
+
+  std::ofstream out(json);
+  if (!out.is_open()) {
+    std::cerr << "Unable to open file: " << json << std::endl;
+    return 1;
+  }
+  write_json(out, rows);
+  std::cout << "Results written to " << json << std::endl;
+  return 0;
+}
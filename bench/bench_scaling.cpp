@@ -0,0 +1,294 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "EventDrivenSimulation.h"
+#include "config.h"
+#include "sphere_simulation.h"
+
+/**
+ * Scaling study of both engines. runs each over sphere counts spanning
+ * several orders of magnitude, at the density run_simulation derives from
+ * the count, and fits the time per run to c * N^k.
+ *
+ * the radius shrinks with N, so every sphere crosses more cells and the
+ * number of events grows faster than N by itself. the time is therefore
+ * also fitted against the number of events, and an engine is flagged as
+ * not scaling near linearly once the local exponent of that, between
+ * neighbouring counts, goes above --max-exponent. prints a table and writes
+ * the results as JSON.
+ *
+ *   bench_scaling [--counts 1000,10000,100000] [--engines event_driven]
+ *                 [--legacy-limit 10000] [--max-exponent 1.2] [--seed 1]
+ *                 [--repeats 1] [--json bench_scaling.json]
+ */
+
+namespace {
+
+struct Point {
+  int n;
+  int spheres = 0; // the Poisson draw around n
+  double init_seconds = 0;
+  double run_seconds = 0;
+  long events = 0;
+  // from the point before, against N and against events. 0 for the first
+  double local_exponent = 0;
+  double local_event_exponent = 0;
+};
+
+// exponent and goodness of a least squares fit of log y against log x
+struct PowerLaw {
+  double exponent = 0;
+  double r_squared = 0;
+};
+
+struct Fit {
+  std::string engine;
+  std::vector<Point> points;
+  PowerLaw in_n;      // seconds ~ N^k
+  PowerLaw in_events; // seconds ~ events^k
+  int nonlinear_from = -1; // first count past the exponent limit, -1 if none
+
+  double seconds(const Point &p) const {
+    return p.init_seconds + p.run_seconds;
+  }
+};
+
+template <typename T> std::vector<T> parse_list(const std::string &arg) {
+  std::vector<T> values;
+  std::stringstream in(arg);
+  std::string item;
+  while (std::getline(in, item, ',')) {
+    std::stringstream value(item);
+    T x;
+    value >> x;
+    values.push_back(x);
+  }
+  return values;
+}
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+template <typename Simulation>
+void run(Simulation &simulation, std::chrono::steady_clock::time_point start,
+         Point &point) {
+  simulation.initialize_events();
+  point.init_seconds = seconds_since(start);
+
+  auto run_start = std::chrono::steady_clock::now();
+  simulation.run_simulation();
+  point.run_seconds = seconds_since(run_start);
+  point.events = simulation.get_event_count();
+}
+
+Point measure(const std::string &engine, int n, std::uint64_t seed) {
+  Point point;
+  point.n = n;
+  auto start = std::chrono::steady_clock::now();
+  if (engine == "sphere_simulation") {
+    sphere_simulation simulation(n, seed);
+    point.spheres = simulation.get_number_of_spheres();
+    run(simulation, start, point);
+  } else {
+    EventDrivenSimulation simulation(QueueType::HEAP);
+    simulation.reset(n, seed);
+    point.spheres = simulation.get_spheres().size();
+    run(simulation, start, point);
+  }
+  return point;
+}
+
+// the repeat with the median total time
+Point median_run(const std::string &engine, int n, std::uint64_t seed,
+                 int repeats) {
+  std::vector<Point> runs;
+  for (int r = 0; r < repeats; r++) {
+    runs.push_back(measure(engine, n, seed));
+  }
+  std::sort(runs.begin(), runs.end(), [](const Point &a, const Point &b) {
+    return a.init_seconds + a.run_seconds < b.init_seconds + b.run_seconds;
+  });
+  return runs[runs.size() / 2];
+}
+
+PowerLaw power_law(const std::vector<double> &x, const std::vector<double> &y) {
+  int m = (int)x.size();
+  double sx = 0, sy = 0, sxx = 0, sxy = 0, syy = 0;
+  for (int i = 0; i < m; i++) {
+    double lx = std::log(x[i]), ly = std::log(y[i]);
+    sx += lx;
+    sy += ly;
+    sxx += lx * lx;
+    sxy += lx * ly;
+    syy += ly * ly;
+  }
+
+  PowerLaw law;
+  if (m < 2) {
+    return law;
+  }
+  double var_x = sxx - sx * sx / m;
+  double var_y = syy - sy * sy / m;
+  double cov = sxy - sx * sy / m;
+  law.exponent = var_x > 0 ? cov / var_x : 0;
+  law.r_squared = var_x > 0 && var_y > 0 ? cov * cov / (var_x * var_y) : 1;
+  return law;
+}
+
+double local_exponent(double x0, double y0, double x1, double y1) {
+  return x1 > x0 && y0 > 0 ? std::log(y1 / y0) / std::log(x1 / x0) : 0;
+}
+
+void fit(Fit &f, double max_exponent) {
+  std::vector<double> n, events, seconds;
+  for (size_t i = 0; i < f.points.size(); i++) {
+    Point &p = f.points[i];
+    n.push_back(p.n);
+    events.push_back(std::max(1L, p.events));
+    seconds.push_back(f.seconds(p));
+
+    if (i > 0) {
+      p.local_exponent =
+          local_exponent(n[i - 1], seconds[i - 1], n[i], seconds[i]);
+      p.local_event_exponent =
+          local_exponent(events[i - 1], seconds[i - 1], events[i], seconds[i]);
+      if (p.local_event_exponent > max_exponent && f.nonlinear_from < 0) {
+        f.nonlinear_from = p.n;
+      }
+    }
+  }
+  f.in_n = power_law(n, seconds);
+  f.in_events = power_law(events, seconds);
+}
+
+void write_json(std::ostream &out, const std::vector<Fit> &fits,
+                std::uint64_t seed, double max_exponent) {
+  out << "{\n  \"dimensions\": " << DIMENSIONS
+      << ",\n  \"max_simulation_time\": " << MAX_SIMULATION_TIME
+      << ",\n  \"seed\": " << seed << ",\n  \"max_exponent\": " << max_exponent
+      << ",\n  \"engines\": [";
+  for (size_t i = 0; i < fits.size(); i++) {
+    const Fit &f = fits[i];
+    out << (i == 0 ? "\n" : ",\n") << "    {\"engine\": \"" << f.engine
+        << "\", \"exponent\": " << f.in_n.exponent
+        << ", \"r_squared\": " << f.in_n.r_squared
+        << ", \"event_exponent\": " << f.in_events.exponent
+        << ", \"event_r_squared\": " << f.in_events.r_squared
+        << ", \"near_linear\": " << (f.nonlinear_from < 0 ? "true" : "false")
+        << ", \"nonlinear_from\": " << f.nonlinear_from << ", \"points\": [";
+    for (size_t j = 0; j < f.points.size(); j++) {
+      const Point &p = f.points[j];
+      out << (j == 0 ? "\n" : ",\n") << "      {\"n\": " << p.n
+          << ", \"spheres\": " << p.spheres
+          << ", \"seconds\": " << f.seconds(p)
+          << ", \"init_seconds\": " << p.init_seconds
+          << ", \"run_seconds\": " << p.run_seconds
+          << ", \"events\": " << p.events
+          << ", \"local_exponent\": " << p.local_exponent
+          << ", \"local_event_exponent\": " << p.local_event_exponent << "}";
+    }
+    out << "\n    ]}";
+  }
+  out << "\n  ]\n}\n";
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::vector<int> counts = {1000, 3162, 10000, 31623, 100000};
+  std::vector<std::string> engines = {"sphere_simulation", "event_driven"};
+  // sphere_simulation looks at every pair, so it is only run up to here
+  int legacy_limit = 10000;
+  double max_exponent = 1.2;
+  std::uint64_t seed = 1;
+  int repeats = 1;
+  std::string json = "bench_scaling.json";
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--help" || i + 1 >= argc) {
+      std::cout << "usage: " << argv[0]
+                << " [--counts 1000,10000,100000]"
+                   " [--engines sphere_simulation,event_driven]"
+                   " [--legacy-limit 10000] [--max-exponent 1.2] [--seed 1]"
+                   " [--repeats 1] [--json file]"
+                << std::endl;
+      return arg == "--help" ? 0 : 1;
+    }
+    std::string value = argv[++i];
+    if (arg == "--counts") {
+      counts = parse_list<int>(value);
+    } else if (arg == "--engines") {
+      engines = parse_list<std::string>(value);
+    } else if (arg == "--legacy-limit") {
+      legacy_limit = std::stoi(value);
+    } else if (arg == "--max-exponent") {
+      max_exponent = std::stod(value);
+    } else if (arg == "--seed") {
+      seed = std::stoull(value);
+    } else if (arg == "--repeats") {
+      repeats = std::max(1, std::stoi(value));
+    } else if (arg == "--json") {
+      json = value;
+    } else {
+      std::cerr << "unknown option " << arg << std::endl;
+      return 1;
+    }
+  }
+  std::sort(counts.begin(), counts.end());
+
+  std::vector<Fit> fits;
+  std::printf("%-18s %9s %9s %10s %10s %12s %9s %9s\n", "engine", "n",
+              "spheres", "seconds", "run s", "events", "k in N", "k events");
+  for (const std::string &engine : engines) {
+    if (engine != "sphere_simulation" && engine != "event_driven") {
+      std::cerr << "unknown engine " << engine << std::endl;
+      return 1;
+    }
+
+    Fit f;
+    f.engine = engine;
+    for (int n : counts) {
+      if (engine == "sphere_simulation" && n > legacy_limit) {
+        continue;
+      }
+      f.points.push_back(median_run(engine, n, seed, repeats));
+    }
+    fit(f, max_exponent);
+
+    for (const Point &p : f.points) {
+      std::printf("%-18s %9d %9d %10.3f %10.3f %12ld %9.2f %9.2f\n",
+                  engine.c_str(), p.n, p.spheres, f.seconds(p), p.run_seconds,
+                  p.events, p.local_exponent, p.local_event_exponent);
+    }
+    std::printf("%-18s fit N^%.3f (r^2 %.3f), events^%.3f (r^2 %.3f)",
+                engine.c_str(), f.in_n.exponent, f.in_n.r_squared,
+                f.in_events.exponent, f.in_events.r_squared);
+    if (f.nonlinear_from >= 0) {
+      std::printf(", not near linear from N = %d", f.nonlinear_from);
+    }
+    std::printf("\n");
+    std::fflush(stdout);
+    fits.push_back(f);
+  }
+
+  std::ofstream out(json);
+  if (!out.is_open()) {
+    std::cerr << "Unable to open file: " << json << std::endl;
+    return 1;
+  }
+  write_json(out, fits, seed, max_exponent);
+  std::cout << "Results written to " << json << std::endl;
+  return 0;
+}
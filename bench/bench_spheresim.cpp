@@ -0,0 +1,318 @@
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include "EventDrivenSimulation.h"
+#include "Philox.h"
+#include "Sphere.h"
+#include "Trace.h"
+#include "config.h"
+#include "sphere_simulation.h"
+#include "vec3.h"
+
+/**
+ * End to end benchmark of both engines over a matrix of sphere counts and
+ * densities. every case places the same spheres for both engines, drawn from
+ * a fixed seed, and runs them to MAX_SIMULATION_TIME. prints a table and
+ * writes the results as JSON.
+ *
+ * --sectors runs the grid engine once for every sector count, see
+ * set_sector_count, so the speedup of parallel sectors over the serial run
+ * can be read off the table, along with how much they took back.
+ *
+ * with --trace, the phases of every run are also written to a Chrome trace,
+ * recording every --trace-sampling-th event. that needs the phase timers,
+ * see COLLECT_TRACE.
+ *
+ *   bench_spheresim [--counts 1000,4000] [--densities 0.001,0.01]
+ *                   [--engines sphere_simulation,event_driven] [--seed 1]
+ *                   [--sectors 1,2,4] [--repeats 1]
+ *                   [--json bench_spheresim.json]
+ *                   [--trace trace.json] [--trace-sampling 100]
+ */
+
+namespace {
+
+struct Case {
+  std::string engine;
+  int n;
+  double density; // fraction of the torus the spheres fill
+  double radius;
+  int sectors; // of the grid engine, 1 runs serially
+  int repeat;
+};
+
+struct Result {
+  Case params;
+  double init_seconds = 0; // placing the spheres and predicting the first events
+  double run_seconds = 0;
+  long events = 0;
+  long collisions = 0;
+  long stale_events = 0;
+  long rolled_back = 0; // events parallel sectors handled and took back
+  long peak_rss_kb = 0;
+};
+
+template <typename T> std::vector<T> parse_list(const std::string &arg) {
+  std::vector<T> values;
+  std::stringstream in(arg);
+  std::string item;
+  while (std::getline(in, item, ',')) {
+    std::stringstream value(item);
+    T x;
+    value >> x;
+    values.push_back(x);
+  }
+  return values;
+}
+
+// the radius at which n spheres fill density of the unit torus
+double radius_for(int n, double density) {
+  double unit_ball = std::pow(std::acos(-1.0), DIMENSIONS / 2.0) /
+                     std::tgamma(DIMENSIONS / 2.0 + 1);
+  return std::pow(density / (n * unit_ball), 1.0 / DIMENSIONS);
+}
+
+Sphere *draw_spheres(int n, double radius, std::uint64_t seed) {
+  Sphere *spheres = new Sphere[n];
+  for (int i = 0; i < n; i++) {
+    point3 center;
+    vec3 velocity;
+    draw_sphere<long double, DIMENSIONS>(seed, i, center, velocity);
+    spheres[i] = Sphere(radius, center, velocity);
+  }
+  return spheres;
+}
+
+/**
+ * starts a new peak of the resident set, so the next read only sees what
+ * was used since. on Linux the high water mark can be reset, elsewhere the
+ * peak of the whole process is all there is.
+ */
+void reset_peak_memory() {
+  std::ofstream clear_refs("/proc/self/clear_refs");
+  if (clear_refs) {
+    clear_refs << "5";
+  }
+}
+
+long peak_memory_kb() {
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line)) {
+    if (line.compare(0, 6, "VmHWM:") == 0) {
+      return std::atol(line.c_str() + 6);
+    }
+  }
+
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+template <typename Simulation>
+void run_engine(Simulation &simulation,
+                std::chrono::steady_clock::time_point start, Result &result) {
+  simulation.initialize_events();
+  result.init_seconds = seconds_since(start);
+
+  auto run_start = std::chrono::steady_clock::now();
+  simulation.run_simulation();
+  result.run_seconds = seconds_since(run_start);
+
+  result.events = simulation.get_event_count();
+  result.collisions = (long)simulation.get_collision_times().size();
+  result.stale_events = simulation.get_stale_event_count();
+}
+
+void run_engine(EventDrivenSimulation &simulation,
+                std::chrono::steady_clock::time_point start, Result &result) {
+  simulation.set_sector_count(result.params.sectors);
+  run_engine<EventDrivenSimulation>(simulation, start, result);
+  result.rolled_back = simulation.get_rolled_back_count();
+}
+
+Result run_case(const Case &params, std::uint64_t seed) {
+  Result result;
+  result.params = params;
+  reset_peak_memory();
+
+  auto start = std::chrono::steady_clock::now();
+  Sphere *spheres = draw_spheres(params.n, params.radius, seed);
+  // both engines take ownership of the spheres
+  if (params.engine == "sphere_simulation") {
+    sphere_simulation simulation(params.n, spheres);
+    run_engine(simulation, start, result);
+  } else {
+    EventDrivenSimulation simulation(params.n, spheres);
+    run_engine(simulation, start, result);
+  }
+
+  result.peak_rss_kb = peak_memory_kb();
+  return result;
+}
+
+double per_second(long count, double seconds) {
+  return seconds > 0 ? count / seconds : 0;
+}
+
+double ns_per(double seconds, long count) {
+  return count > 0 ? seconds * 1e9 / count : 0;
+}
+
+void write_json(std::ostream &out, const std::vector<Result> &results,
+                std::uint64_t seed) {
+  out << "{\n  \"dimensions\": " << DIMENSIONS
+      << ",\n  \"max_simulation_time\": " << MAX_SIMULATION_TIME
+      << ",\n  \"seed\": " << seed << ",\n  \"results\": [";
+  for (size_t i = 0; i < results.size(); i++) {
+    const Result &r = results[i];
+    out << (i == 0 ? "\n" : ",\n") << "    {\"engine\": \"" << r.params.engine
+        << "\", \"n\": " << r.params.n << ", \"density\": " << r.params.density
+        << ", \"radius\": " << r.params.radius
+        << ", \"sectors\": " << r.params.sectors
+        << ", \"repeat\": " << r.params.repeat
+        << ", \"init_seconds\": " << r.init_seconds
+        << ", \"run_seconds\": " << r.run_seconds
+        << ", \"events\": " << r.events
+        << ", \"collisions\": " << r.collisions
+        << ", \"stale_events\": " << r.stale_events
+        << ", \"rolled_back\": " << r.rolled_back
+        << ", \"events_per_second\": " << per_second(r.events, r.run_seconds)
+        << ", \"ns_per_event\": " << ns_per(r.run_seconds, r.events)
+        << ", \"peak_rss_kb\": " << r.peak_rss_kb << "}";
+  }
+  out << "\n  ]\n}\n";
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::vector<int> counts = {1000, 4000, 16000};
+  std::vector<double> densities = {0.001, 0.005, 0.02};
+  std::vector<std::string> engines = {"sphere_simulation", "event_driven"};
+  std::vector<int> sector_counts = {1};
+  std::uint64_t seed = 1;
+  int repeats = 1;
+  std::string json = "bench_spheresim.json";
+  std::string trace;
+  int trace_sampling = 100;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--help" || i + 1 >= argc) {
+      std::cout << "usage: " << argv[0]
+                << " [--counts 1000,4000] [--densities 0.001,0.01]"
+                   " [--engines sphere_simulation,event_driven] [--seed 1]"
+                   " [--sectors 1,2,4] [--repeats 1] [--json file]"
+                   " [--trace file]"
+                   " [--trace-sampling 100]"
+                << std::endl;
+      return arg == "--help" ? 0 : 1;
+    }
+    std::string value = argv[++i];
+    if (arg == "--counts") {
+      counts = parse_list<int>(value);
+    } else if (arg == "--densities") {
+      densities = parse_list<double>(value);
+    } else if (arg == "--engines") {
+      engines = parse_list<std::string>(value);
+    } else if (arg == "--seed") {
+      seed = std::stoull(value);
+    } else if (arg == "--sectors") {
+      sector_counts = parse_list<int>(value);
+    } else if (arg == "--repeats") {
+      repeats = std::stoi(value);
+    } else if (arg == "--json") {
+      json = value;
+    } else if (arg == "--trace") {
+      trace = value;
+    } else if (arg == "--trace-sampling") {
+      trace_sampling = std::stoi(value);
+    } else {
+      std::cerr << "unknown option " << arg << std::endl;
+      return 1;
+    }
+  }
+
+  for (const std::string &engine : engines) {
+    if (engine != "sphere_simulation" && engine != "event_driven") {
+      std::cerr << "unknown engine " << engine << std::endl;
+      return 1;
+    }
+  }
+
+  if (!trace.empty()) {
+    if (!COLLECT_TRACE) {
+      std::cerr << "the phase timers are not compiled in, see COLLECT_TRACE"
+                << std::endl;
+    }
+    Tracer::get().start(trace_sampling);
+  }
+
+  std::vector<Result> results;
+  std::printf("%-18s %8s %8s %7s %9s %9s %10s %12s %10s %11s %10s\n",
+              "engine", "n", "density", "sectors", "init s", "run s",
+              "events", "events/s", "ns/event", "rolled back", "peak MB");
+  for (int n : counts) {
+    for (double density : densities) {
+      for (const std::string &engine : engines) {
+        // only the grid engine runs in sectors
+        std::vector<int> sectors =
+            engine == "event_driven" ? sector_counts : std::vector<int>{1};
+        for (int sector_count : sectors) {
+          for (int repeat = 0; repeat < repeats; repeat++) {
+            Case params{engine, n, density, radius_for(n, density),
+                        sector_count, repeat};
+            Result r = run_case(params, seed);
+            results.push_back(r);
+
+            std::printf(
+                "%-18s %8d %8g %7d %9.3f %9.3f %10ld %12.0f %10.1f %11ld "
+                "%10.1f\n",
+                engine.c_str(), n, density, sector_count, r.init_seconds,
+                r.run_seconds, r.events, per_second(r.events, r.run_seconds),
+                ns_per(r.run_seconds, r.events), r.rolled_back,
+                r.peak_rss_kb / 1024.0);
+            std::fflush(stdout);
+          }
+        }
+      }
+    }
+  }
+
+  std::ofstream out(json);
+  if (!out.is_open()) {
+    std::cerr << "Unable to open file: " << json << std::endl;
+    return 1;
+  }
+  write_json(out, results, seed);
+  std::cout << "Results written to " << json << std::endl;
+
+  if (!trace.empty()) {
+    Tracer::get().stop();
+    std::ofstream trace_out(trace);
+    if (!trace_out.is_open()) {
+      std::cerr << "Unable to open file: " << trace << std::endl;
+      return 1;
+    }
+    Tracer::get().write_json(trace_out);
+    std::cout << "Trace written to " << trace << std::endl;
+  }
+  return 0;
+}
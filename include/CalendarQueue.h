@@ -0,0 +1,67 @@
+#ifndef CALENDAR_QUEUE_H
+#define CALENDAR_QUEUE_H
+
+#include <vector>
+
+#include "Event.h"
+#include "EventQueue.h"
+
+/**
+ * A calendar queue (R. Brown, 1988) holding one pending event per sphere.
+ *
+ * Time is split into "days" of a fixed width and day d is stored in bucket
+ * d % bucket_count, so a full pass over the buckets covers one "year".
+ * Scheduling is O(1): an event is dropped into its bucket (and swapped out
+ * of its old one). Finding the earliest event scans forward from the day of
+ * the last event handed out and stops at the first bucket that has an event
+ * inside its current day, which is O(1) amortised when the bucket width
+ * matches the spacing of events.
+ *
+ * The bucket count follows the number of pending events and the bucket width
+ * follows the observed gaps between successive events, so the calendar
+ * resizes itself as the simulation runs.
+ */
+class CalendarQueue : public EventQueue {
+public:
+  CalendarQueue() = default;
+  CalendarQueue(int size);
+
+  void update(int i, const Event &event) override;
+  // sizes the calendar for the new events and files each of them once
+  void assign(const std::vector<Event> &events) override;
+
+  const Event &top() const override;
+  int top_index() const override;
+  const Event &get(int i) const override { return events[i]; }
+
+  bool empty() const override { return active == 0; }
+  int size() const override { return (int)events.size(); }
+
+  int get_bucket_count() const { return (int)buckets.size(); }
+  long double get_bucket_width() const { return width; }
+
+private:
+  std::vector<Event> events;             // pending event of each sphere
+  std::vector<std::vector<int>> buckets; // sphere indices in each bucket
+  std::vector<int> bucket_of;            // bucket of each sphere, -1 if none
+  std::vector<int> slot_of;              // position of each sphere in bucket
+
+  long double width = 1.0;
+  int active = 0; // spheres with a pending event
+
+  // search state, updated by top()
+  mutable long double last_time = 0; // time of the last event handed out
+  mutable int cached_top = -1;       // -1 when the top has to be searched
+  mutable long double mean_gap = 0;  // moving average of gaps between tops
+  mutable long gap_samples = 0;
+  mutable long searches = 0;         // tops searched since the last resize
+
+  int bucket_index(long double time) const;
+  void insert(int i);
+  void erase(int i);
+  int search() const;
+  void resize(int bucket_count, long double bucket_width);
+  void maybe_resize();
+};
+
+#endif // CALENDAR_QUEUE_H
@@ -0,0 +1,72 @@
+#ifndef COLLISION_KERNEL_H
+#define COLLISION_KERNEL_H
+
+#include <vector>
+
+#include "config.h"
+
+/**
+ * Candidate spheres packed for the batched collision kernel. Coordinates are
+ * stored one array per dimension and already projected to the time of the
+ * sphere they are tested against, so the kernel can load a whole vector of
+ * candidates at once.
+ */
+template <typename Scalar, int Dim = DIMENSIONS> struct CandidateBlock {
+  std::vector<Scalar> center[Dim];
+  std::vector<Scalar> velocity[Dim];
+  std::vector<Scalar> radius;
+  std::vector<int> index; // sphere index of each candidate
+
+  inline int size() const { return (int)this->index.size(); }
+
+  // keeps the capacity, so a block can be reused without allocating
+  void clear() {
+    for (int d = 0; d < Dim; d++) {
+      this->center[d].clear();
+      this->velocity[d].clear();
+    }
+    this->radius.clear();
+    this->index.clear();
+  }
+
+  void push_back(int i, const Scalar *c, const Scalar *v, Scalar r) {
+    for (int d = 0; d < Dim; d++) {
+      this->center[d].push_back(c[d]);
+      this->velocity[d].push_back(v[d]);
+    }
+    this->radius.push_back(r);
+    this->index.push_back(i);
+  }
+};
+
+enum class KernelType { SCALAR, AVX2, AVX512 };
+
+/**
+ * returns true if the cpu the program runs on can execute the kernel.
+ */
+bool kernel_supported(KernelType type);
+
+/**
+ * the kernel predict_collisions dispatches to. defaults to the widest one
+ * the cpu supports. unsupported kernels fall back to the scalar one.
+ */
+KernelType get_kernel_type();
+void set_kernel_type(KernelType type);
+
+/**
+ * predicts the collision of one sphere with every candidate in block. times
+ * receives block.size() entries, each the time until the sphere hits that
+ * candidate or -1 if they do not collide, with the same discriminant test
+ * and root selection as collide. torus_size > 0 tests against the nearest
+ * image of each candidate.
+ *
+ * float and double run on the selected SIMD kernel, long double always runs
+ * on the scalar one. all kernels give bit-identical results.
+ */
+template <typename Scalar, int Dim>
+void predict_collisions(const Scalar *center, const Scalar *velocity,
+                        Scalar radius, Scalar torus_size,
+                        const CandidateBlock<Scalar, Dim> &block,
+                        Scalar *times);
+
+#endif // COLLISION_KERNEL_H
@@ -0,0 +1,63 @@
+#ifndef ENSEMBLE_H
+#define ENSEMBLE_H
+
+#include <cstdint>
+#include <vector>
+
+#include "EventDrivenSimulation.h"
+#include "EventQueue.h"
+#include "config.h"
+
+/**
+ * Runs independent replicas of BasicEventDrivenSimulation, each with about n
+ * spheres, on a pool of threads. replica r is drawn from get_replica_seed,
+ * so its results do not depend on the number of threads or on which thread
+ * ran it. every thread keeps a single simulation and resets it for each
+ * replica it takes, so memory is only allocated once per thread.
+ */
+template <typename Scalar, int Dim = DIMENSIONS> class BasicEnsemble {
+public:
+  BasicEnsemble(int n, int replica_count, std::uint64_t seed,
+                QueueType queue_type = QueueType::HEAP);
+
+  /**
+   * runs every replica. threads take the next replica off a shared counter
+   * and write its results into a slot of its own, so nothing else is shared
+   * and no lock is taken.
+   */
+  void run();
+
+  int get_replica_count() const { return replica_count; }
+  const std::vector<long double> &get_collision_times(int r) const {
+    return collision_times[r];
+  }
+  long get_stale_event_count(int r) const { return stale_events[r]; }
+  // the collision times of every replica merged into one sorted vector
+  std::vector<long double> get_merged_collision_times() const;
+
+  // the seed of replica r, a mix of seed and r so nearby seeds do not overlap
+  static std::uint64_t get_replica_seed(std::uint64_t seed, int r);
+
+  /**
+   * the number of threads replicas are run on, 0 for one per hardware
+   * thread. every replica itself runs on a single thread. defaults to
+   * THREAD_COUNT.
+   */
+  void set_thread_count(int count) { thread_count = count; }
+  int get_thread_count() const { return thread_count; }
+
+private:
+  int n;
+  int replica_count;
+  std::uint64_t seed;
+  QueueType queue_type;
+  int thread_count = THREAD_COUNT;
+
+  // one slot per replica, only ever written by the thread running it
+  std::vector<std::vector<long double>> collision_times;
+  std::vector<long> stale_events;
+};
+
+using Ensemble = BasicEnsemble<long double>;
+
+#endif // ENSEMBLE_H
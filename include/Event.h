@@ -0,0 +1,70 @@
+#ifndef EVENT_H
+#define EVENT_H
+
+#include <cmath>
+#include <limits>
+
+/**
+ * A predicted collision between two spheres, or a transfer of one sphere into
+ * a neighbouring grid cell (s2 is -1). Spheres are referred to by their index
+ * in the simulation. The collision counters of the spheres are stamped into
+ * the event when it is created, so the event can be discarded as stale as
+ * soon as either sphere has collided since.
+ */
+struct Event {
+  long double time;
+  int s1;
+  int s2;
+  int s1_collisions;
+  int s2_collisions;
+
+  // an empty event that never happens
+  Event()
+      : time(std::numeric_limits<long double>::infinity()), s1(-1), s2(-1),
+        s1_collisions(0), s2_collisions(0) {}
+
+  Event(long double time, int s1, int s2, int s1_collisions,
+        int s2_collisions)
+      : time(time), s1(s1), s2(s2), s1_collisions(s1_collisions),
+        s2_collisions(s2_collisions) {}
+
+  // a cell transfer of s
+  Event(long double time, int s, int s_collisions)
+      : time(time), s1(s), s2(-1), s1_collisions(s_collisions),
+        s2_collisions(0) {}
+
+  inline bool is_transfer() const { return s2 < 0; }
+
+  /**
+   * returns true if either sphere has collided since the event was predicted.
+   * collision_count(i) has to return the current collision counter of sphere
+   * i.
+   */
+  template <typename CollisionCount>
+  inline bool is_stale(CollisionCount collision_count) const {
+    if (s1 < 0) {
+      return false; // an empty event has nothing to invalidate
+    }
+    return collision_count(s1) != s1_collisions ||
+           (s2 >= 0 && collision_count(s2) != s2_collisions);
+  }
+
+  inline friend bool operator<(const Event &e1, const Event &e2) {
+    return e1.time > e2.time; // for min-heap
+  }
+};
+
+/**
+ * time rounded down to a double, for publishing event times through a
+ * std::atomic<double>. a time read back from it is never later than the
+ * event, so nothing waiting on it can get past the event.
+ */
+inline double time_floor(long double time) {
+  double floor = (double)time;
+  if (floor > time) {
+    floor = std::nextafter(floor, -std::numeric_limits<double>::infinity());
+  }
+  return floor;
+}
+
+#endif // EVENT_H
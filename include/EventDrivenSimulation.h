@@ -1,50 +1,302 @@
 #ifndef EVENT_DRIVEN_SIMULATION_H
 #define EVENT_DRIVEN_SIMULATION_H
 
-#include <queue>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <ostream>
 #include <vector>
 
+#include "CollisionKernel.h"
+#include "Event.h"
+#include "EventQueue.h"
+#include "MultiQueue.h"
+#include "PartitionedEventHeap.h"
 #include "SpatialGrid.h"
 #include "Sphere.h"
+#include "SphereStore.h"
+#include "Stats.h"
+#include "Trace.h"
 #include "config.h"
 #include "vec3.h"
 
-struct Event {
-  long double time;
-  Sphere *s1;
-  Sphere *s2;
+/**
+ * How sectors that run in parallel keep to the order of the serial run.
+ * both run one thread per sector. WINDOWS runs in rounds, in which every
+ * sector handles its own events, up to where its neighbours have got, until
+ * it meets one that reaches across a sector border. those are then handled
+ * one at a time, taking back the sectors next to each that ran past it.
+ * TIME_WARP has no rounds: every sector also handles its own border events
+ * as it meets them, once its neighbours have got there, and the sectors
+ * around one that ran past it are taken back then.
+ * MULTI_QUEUE has the threads of set_thread_count take events from a
+ * MultiQueue over the sectors, and only handles an event once no sector it
+ * could depend on has an earlier one pending, so nothing is taken back.
+ */
+enum class SectorScheduling { WINDOWS, TIME_WARP, MULTI_QUEUE };
 
-  Event(long double time, Sphere *s1, Sphere *s2)
-      : time(time), s1(s1), s2(s2) {}
-
-  inline friend bool operator<(const Event &e1, const Event &e2) {
-    return e1.time > e2.time;
-  }
-};
-
-class EventDrivenSimulation {
+/**
+ * Event-driven hard sphere simulation on a spatial grid. Scalar is the
+ * floating point type spheres are stored and collisions are predicted in.
+ * double is fast enough for production runs, long double is kept as the
+ * reference precision. Dim is the number of dimensions, any of 2, 3 and 4
+ * can be used side by side.
+ */
+template <typename Scalar, int Dim = DIMENSIONS>
+class BasicEventDrivenSimulation {
 public:
-  EventDrivenSimulation(int n);
-  // ~EventDrivenSimulation(); default destructor is fine
+  BasicEventDrivenSimulation(int n, QueueType queue_type = QueueType::HEAP);
+  // without any spheres until reset is called
+  explicit BasicEventDrivenSimulation(QueueType queue_type);
+  // takes ownership of spheres. the cell size is derived from their radius
+  BasicEventDrivenSimulation(int n, BasicSphere<Dim> *spheres,
+                             QueueType queue_type = QueueType::HEAP);
+  // ~BasicEventDrivenSimulation(); default destructor is fine
+
+  /**
+   * starts over with a new random set of about n spheres drawn from seed, so
+   * the same seed always gives the same run, whatever the thread count. the
+   * memory of the last run is reused, which makes running many replicas one
+   * after the other cheap.
+   * initialize_events has to be called again before running.
+   */
+  void reset(int n, std::uint64_t seed);
 
   void initialize_events();
   void run_simulation();
   void run_simulation_step();
 
-  std::vector<long double> get_collision_times() { return collision_times; }
+  std::vector<long double> get_collision_times() {
+    return serial.collision_times;
+  }
+  const BasicSphereStore<Scalar, Dim> &get_spheres() const {
+    return grid.get_spheres();
+  }
+  // sphere i in the order the spheres were passed in, however they are stored
+  BasicSphere<Dim> get_sphere(int i) const {
+    return grid.get_spheres().get_sphere(grid.get_index(i));
+  }
+  Scalar get_current_time() const { return serial.current_time; }
+  // events handled so far, collisions, cell transfers and stale ones alike
+  long get_event_count() const { return serial.events; }
+  long get_stale_event_count() const { return serial.stale_events; }
+  // events parallel sectors handled ahead of time and then took back
+  long get_rolled_back_count() const { return serial.rolled_back; }
+
+  /**
+   * what the run so far spent its work on, see SimulationStats. apart from
+   * the event counts it is only kept when COLLECT_STATS is set. work parallel
+   * sectors did ahead of time and then took back is counted too.
+   */
+  SimulationStats get_stats() const {
+    SimulationStats stats = serial.stats;
+    stats.events = serial.events;
+    stats.stale_events = serial.stale_events;
+    stats.rolled_back = serial.rolled_back;
+    return stats;
+  }
+  // run_simulation writes get_stats to out as JSON once done. nullptr for none
+  void set_stats_output(std::ostream *out) { stats_output = out; }
+
+  /**
+   * the number of events between reorderings of the sphere storage along a
+   * space-filling curve, see BasicSpatialGrid::reorder. 0 turns it off.
+   * defaults to REORDER_INTERVAL.
+   */
+  void set_reorder_interval(long interval) { reorder_interval = interval; }
+  long get_reorder_interval() const { return reorder_interval; }
+
+  /**
+   * the number of threads initialize_events predicts on, 0 for one per
+   * hardware thread. defaults to THREAD_COUNT. the events do not depend on
+   * it.
+   */
+  void set_thread_count(int count) { thread_count = count; }
+  int get_thread_count() const { return thread_count; }
+
+  /**
+   * the number of sectors run_simulation splits the torus into, each handled
+   * on a thread of its own, 0 for one per hardware thread. 1 runs serially.
+   * the grid may make fewer, see BasicSpatialGrid::set_sector_count. events
+   * are handled in the same order either way, so the results do not depend
+   * on it. defaults to SECTOR_COUNT.
+   */
+  void set_sector_count(int count) { sector_count = count; }
+  int get_sector_count() const { return sector_count; }
+  void set_sector_scheduling(SectorScheduling scheduling) {
+    sector_scheduling = scheduling;
+  }
+  SectorScheduling get_sector_scheduling() const { return sector_scheduling; }
 
 private:
-  long double current_time;
-  int sphere_count;
-  long double max_dt;
+  // what a sector needs to take back an event it handled ahead of time
+  struct Undo {
+    long double time;
+    int spheres[2] = {-1, -1}; // -1 if unused
+    typename BasicSpatialGrid<Scalar, Dim>::SphereState state[2];
+    Event next_collision[2];
+    Event pending[2];
+    int partition[2]; // the sector each sphere was queued in
+    // a time warp event across a border also touches other sectors. they
+    // get a record that only points back at the owner, the sector that
+    // handled it, and taking back either takes back the other
+    std::vector<int> linked;
+    int owner = -1;
+    size_t collision_count;
+    long events;
+    long stale_events;
+  };
 
-  std::vector<long double> collision_times;
-  std::priority_queue<Event> event_queue;
-  SpatialGrid grid;
+  /**
+   * everything handling an event writes besides the spheres themselves. the
+   * serial run has one, and while sectors run in parallel every sector has
+   * its own, working on its own part of the queue.
+   */
+  struct Worker {
+    EventQueue *queue = nullptr;
+    Scalar current_time = 0;
+    long events = 0;
+    long stale_events = 0; // events discarded because a sphere collided since
+    long rolled_back = 0;  // events taken back, see get_rolled_back_count
+    std::vector<long double> collision_times;
+    // reused between searches so they do not allocate
+    CandidateBlock<Scalar, Dim> candidates;
+    std::vector<Scalar> candidate_times;
+    SimulationStats stats;
+    // events handled ahead of time that may still be taken back, oldest first
+    std::deque<Undo> undo;
+  };
 
+  /**
+   * what the sectors of a time warp run share. every sector is guarded by
+   * its lock. border events also hold border, so they are handled one at a
+   * time, while the other sectors go on with their own events.
+   */
+  struct TimeWarp {
+    TimeWarp(PartitionedEventHeap &queue, std::vector<Worker> &workers)
+        : queue(queue), workers(workers), progress(workers.size()),
+          locks(workers.size()) {}
 
-  void handle_event(Event &event);
-  void find_collision_events(Sphere *s);
+    /**
+     * the global virtual time, before which nothing can be taken back
+     * anymore. if wait is false and border is held, returns what it was
+     * last found to be.
+     */
+    double update_gvt(bool wait) {
+      std::unique_lock<std::mutex> lock(border, std::defer_lock);
+      if (wait) {
+        lock.lock();
+      } else if (!lock.try_lock()) {
+        return gvt.load();
+      }
+      double time = std::numeric_limits<double>::infinity();
+      for (const std::atomic<double> &sector : progress) {
+        time = std::min(time, sector.load());
+      }
+      gvt.store(time);
+      return time;
+    }
+
+    PartitionedEventHeap &queue;
+    std::vector<Worker> &workers;
+    // the earliest pending event of every sector, rounded down. it only
+    // goes down while border is held, so the earliest of them is the
+    // global virtual time
+    std::vector<std::atomic<double>> progress;
+    std::vector<std::mutex> locks;
+    std::mutex border;
+    std::atomic<double> gvt{0};
+  };
+
+  int sphere_count;
+  long reorder_interval = REORDER_INTERVAL;
+  long events_since_reorder = 0;
+  int thread_count = THREAD_COUNT;
+  int sector_count = SECTOR_COUNT;
+  SectorScheduling sector_scheduling = SectorScheduling::WINDOWS;
+  std::ostream *stats_output = nullptr;
+
+  Worker serial;
+  std::unique_ptr<EventQueue> event_queue; // next event of every sphere
+  std::vector<Event> next_collision; // earliest known collision of every sphere
+  BasicSpatialGrid<Scalar, Dim> grid;
+
+  void handle_event(Worker &worker, Event &event);
+  void handle_transfer(Worker &worker, Event &event);
+  void find_collision_events(Worker &worker, int s);
+  // runs the collision kernel for s on block into times
+  void predict_times(int s, const CandidateBlock<Scalar, Dim> &block,
+                     std::vector<Scalar> &times) const;
+  // runs the collision kernel on candidates and keeps the earliest event
+  void predict_candidates(Worker &worker, int s, Event &next_event);
+  // the earlier of the next collision of s and its next cell transfer, with
+  // s at time now
+  Event next_event(int s, Scalar now);
+  void schedule(Worker &worker, int s);
+  // the earliest event of queue. it stays in its slot until replaced
+  static Event top_event(const EventQueue &queue) {
+    TRACE_SCOPE("queue_pop");
+    return queue.top();
+  }
+  // runs to MAX_SIMULATION_TIME with the sectors of the grid in parallel
+  void run_sectors();
+  void run_windows(PartitionedEventHeap &queue, std::vector<Worker> &workers);
+  void run_time_warp(PartitionedEventHeap &queue,
+                     std::vector<Worker> &workers);
+  /**
+   * handles the event at the top of sector p if it reaches across a border,
+   * once every sector it touches has got to it, taking back those that ran
+   * past it. returns false if it has to wait.
+   */
+  bool handle_border(TimeWarp &warp, int p);
+  void run_multi_queue();
+  /**
+   * handles the earliest event of sector p if no sector it could depend on
+   * has an earlier one pending and all of them can be locked. held is left
+   * empty, it only saves allocating. returns false if it has to wait.
+   */
+  bool try_handle(Worker &worker, MultiQueue &queue, int p,
+                  std::vector<int> &held);
+  /**
+   * handles the local events at the top of the queue of worker in order,
+   * keeping an undo record for each, until it meets one that is not local or
+   * that stop(event) is true for, which may wait before it answers. returns
+   * the time of that event, infinity if it ran out of events before
+   * MAX_SIMULATION_TIME.
+   */
+  template <typename Stop>
+  long double run_ahead(Worker &worker, const PartitionedEventHeap &queue,
+                        Stop &&stop);
+  // what it takes to take back event once worker has handled it
+  Undo save_undo(const Worker &worker, const Event &event,
+                 const PartitionedEventHeap &queue) const;
+  /**
+   * takes back the events sector p handled at or after time, latest first,
+   * and with a time warp event across a border the sectors it is linked
+   * to. hold(q) is called for every other sector before it is touched.
+   */
+  template <typename Hold>
+  void roll_back(std::vector<Worker> &workers, PartitionedEventHeap &queue,
+                 int p, long double time, Hold &&hold);
+  // drops the undo records of worker from before time, which are kept
+  void commit(Worker &worker, long double time);
+  /**
+   * true if handling event only touches spheres and cells of the sector of
+   * its queue partition, so it can run alongside the other sectors.
+   */
+  bool is_local(const Event &event, const PartitionedEventHeap &queue) const;
+  // reorders the spheres in the grid and renumbers every event to match
+  void reorder_spheres();
+  inline bool is_stale(const Event &event) const {
+    const BasicSphereStore<Scalar, Dim> &spheres = this->grid.get_spheres();
+    return event.is_stale([&](int i) { return spheres.collision_count(i); });
+  }
 };
 
+using EventDrivenSimulation = BasicEventDrivenSimulation<long double>;
+
 #endif // EVENT_DRIVEN_SIMULATION_H
\ No newline at end of file
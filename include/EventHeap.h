@@ -0,0 +1,40 @@
+#ifndef EVENT_HEAP_H
+#define EVENT_HEAP_H
+
+#include <vector>
+
+#include "Event.h"
+#include "EventQueue.h"
+#include "IndexedHeap.h"
+
+/**
+ * An indexed binary min-heap holding exactly one "next event" per sphere.
+ *
+ * Slot i belongs to sphere i. Replacing the event of a sphere moves its slot
+ * up or down the heap in place (decrease-key / increase-key), so the heap
+ * never holds more than one entry per sphere and never grows past n.
+ * Spheres without a pending event hold an empty Event with infinite time.
+ */
+class EventHeap : public EventQueue {
+public:
+  EventHeap() = default;
+  EventHeap(int size);
+
+  void update(int i, const Event &event) override;
+  // builds the heap bottom up in O(n)
+  void assign(const std::vector<Event> &events) override;
+
+  const Event &top() const override { return events[heap[0]]; }
+  int top_index() const override { return heap[0]; }
+  const Event &get(int i) const override { return events[i]; }
+
+  bool empty() const override;
+  int size() const override { return (int)heap.size(); }
+
+private:
+  std::vector<Event> events; // pending event of each sphere
+  std::vector<int> heap;     // sphere indices ordered as a binary heap
+  std::vector<int> position; // position of each sphere in heap
+};
+
+#endif // EVENT_HEAP_H
@@ -0,0 +1,53 @@
+#ifndef EVENT_QUEUE_H
+#define EVENT_QUEUE_H
+
+#include <memory>
+#include <vector>
+
+#include "Event.h"
+
+// MULTI is the relaxed MultiQueue, which can also be used from one thread
+enum class QueueType { HEAP, CALENDAR, MULTI };
+
+/**
+ * Scheduler interface shared by the event queue backends. Every backend holds
+ * exactly one pending event per sphere: slot i belongs to sphere i and is
+ * replaced in place whenever the prediction for that sphere changes. Spheres
+ * without a pending event hold an empty Event with infinite time.
+ */
+class EventQueue {
+public:
+  virtual ~EventQueue() = default;
+
+  /**
+   * replaces the pending event of sphere i.
+   */
+  virtual void update(int i, const Event &event) = 0;
+
+  /**
+   * replaces the pending events of all spheres at once, events[i] going to
+   * sphere i. backends rebuild in one pass instead of updating every slot.
+   */
+  virtual void assign(const std::vector<Event> &events);
+
+  /**
+   * clears the pending event of sphere i.
+   */
+  void remove(int i) { update(i, Event()); }
+
+  // the earliest pending event and the sphere it belongs to
+  virtual const Event &top() const = 0;
+  virtual int top_index() const = 0;
+  virtual const Event &get(int i) const = 0;
+
+  // true when no sphere has a pending event
+  virtual bool empty() const = 0;
+  virtual int size() const = 0;
+};
+
+/**
+ * creates an event queue backend with one slot for each of size spheres.
+ */
+std::unique_ptr<EventQueue> make_event_queue(QueueType type, int size);
+
+#endif // EVENT_QUEUE_H
@@ -0,0 +1,79 @@
+#ifndef INDEXED_HEAP_H
+#define INDEXED_HEAP_H
+
+#include <utility>
+#include <vector>
+
+#include "Event.h"
+
+/**
+ * The binary min-heap EventHeap and PartitionedEventHeap keep their slots
+ * in. heap holds sphere indices ordered by the time of their event in
+ * events, and position holds where each sphere is in its heap. a heap may
+ * hold only some of the spheres, position is only read for those.
+ */
+
+inline void heap_swap_nodes(std::vector<int> &heap, std::vector<int> &position,
+                            int a, int b) {
+  std::swap(heap[a], heap[b]);
+  position[heap[a]] = a;
+  position[heap[b]] = b;
+}
+
+inline void heap_sift_up(const std::vector<Event> &events,
+                         std::vector<int> &heap, std::vector<int> &position,
+                         int pos) {
+  while (pos > 0) {
+    int parent = (pos - 1) / 2;
+    if (!(events[heap[pos]].time < events[heap[parent]].time)) {
+      break;
+    }
+    heap_swap_nodes(heap, position, pos, parent);
+    pos = parent;
+  }
+}
+
+inline void heap_sift_down(const std::vector<Event> &events,
+                           std::vector<int> &heap, std::vector<int> &position,
+                           int pos) {
+  int n = (int)heap.size();
+  while (true) {
+    int left = 2 * pos + 1;
+    int right = left + 1;
+    int smallest = pos;
+
+    if (left < n && events[heap[left]].time < events[heap[smallest]].time) {
+      smallest = left;
+    }
+    if (right < n && events[heap[right]].time < events[heap[smallest]].time) {
+      smallest = right;
+    }
+    if (smallest == pos) {
+      break;
+    }
+    heap_swap_nodes(heap, position, pos, smallest);
+    pos = smallest;
+  }
+}
+
+// moves sphere i into place after its event changed from old_time
+inline void heap_update(const std::vector<Event> &events,
+                        std::vector<int> &heap, std::vector<int> &position,
+                        int i, long double old_time) {
+  if (events[i].time < old_time) {
+    heap_sift_up(events, heap, position, position[i]);
+  } else {
+    heap_sift_down(events, heap, position, position[i]);
+  }
+}
+
+// orders heap, whatever order it is in, bottom up in O(n)
+inline void heap_build(const std::vector<Event> &events,
+                       std::vector<int> &heap, std::vector<int> &position) {
+  // every subtree below n / 2 is a single leaf
+  for (int pos = (int)heap.size() / 2 - 1; pos >= 0; pos--) {
+    heap_sift_down(events, heap, position, pos);
+  }
+}
+
+#endif // INDEXED_HEAP_H
@@ -0,0 +1,58 @@
+#ifndef MULTI_QUEUE_H
+#define MULTI_QUEUE_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <vector>
+
+#include "Event.h"
+#include "PartitionedEventHeap.h"
+
+/**
+ * A relaxed concurrent priority queue over the partitions of a
+ * PartitionedEventHeap. Every partition has a lock and publishes the time of
+ * its earliest event, so threads can pick a partition to work on without
+ * locking any: choose samples two partitions and takes the one with the
+ * earlier top. That is not always the globally earliest event, which is
+ * what makes it scale, and callers have to check that an event does not
+ * depend on an earlier one before handling it.
+ *
+ * Partitions have to be locked to be updated or read exactly while other
+ * threads use the queue. Used from a single thread it is an ordinary
+ * EventQueue, with slots spread over the partitions in turn.
+ */
+class MultiQueue : public PartitionedEventHeap {
+public:
+  // the number of partitions make_event_queue gives a multi-queue
+  static constexpr int default_partition_count = 8;
+
+  MultiQueue(int size, int partition_count = default_partition_count);
+
+  void update(int i, const Event &event) override;
+  using PartitionedEventHeap::assign;
+  void assign(const std::vector<Event> &events,
+              const std::vector<int> &owner) override;
+  void move(int i, int p) override;
+
+  /**
+   * the time of the earliest event of partition p as of its last update,
+   * rounded down to double. only a hint unless p is locked.
+   */
+  double peek(int p) const { return tops[p].load(); }
+
+  // two-choice deletion: the one of two random partitions with the earlier top
+  int choose(std::mt19937 &gen) const;
+
+  bool try_lock(int p) { return locks[p].try_lock(); }
+  void unlock(int p) { locks[p].unlock(); }
+
+private:
+  std::unique_ptr<std::mutex[]> locks;
+  std::unique_ptr<std::atomic<double>[]> tops;
+
+  void publish(int p);
+};
+
+#endif // MULTI_QUEUE_H
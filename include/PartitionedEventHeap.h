@@ -0,0 +1,91 @@
+#ifndef PARTITIONED_EVENT_HEAP_H
+#define PARTITIONED_EVENT_HEAP_H
+
+#include <atomic>
+#include <vector>
+
+#include "Event.h"
+#include "EventQueue.h"
+#include "IndexedHeap.h"
+
+/**
+ * One pending event per sphere like EventHeap, but the slots are split
+ * between a number of partitions that each keep a binary min-heap of their
+ * own. Each partition is an EventQueue of its own, see partition(p), and
+ * different partitions can be updated from different threads at the same
+ * time. Used as a whole the queue updates every slot within the partition it
+ * is in and its top is the earliest event of any partition.
+ */
+class PartitionedEventHeap : public EventQueue {
+public:
+  // all slots start out in partition 0
+  PartitionedEventHeap(int size, int partition_count);
+  // the partitions point back at the queue
+  PartitionedEventHeap(const PartitionedEventHeap &) = delete;
+  PartitionedEventHeap &operator=(const PartitionedEventHeap &) = delete;
+  virtual ~PartitionedEventHeap() = default;
+
+  void update(int i, const Event &event) override;
+  /**
+   * keeps every slot in its partition and rebuilds the heaps bottom up.
+   * slots added at the end are spread over the partitions round robin.
+   */
+  void assign(const std::vector<Event> &events) override;
+  /**
+   * replaces every slot like assign, and puts slot i into partition
+   * owner[i].
+   */
+  virtual void assign(const std::vector<Event> &events,
+                      const std::vector<int> &owner);
+
+  const Event &top() const override;
+  int top_index() const override;
+  const Event &get(int i) const override { return events[i]; }
+
+  bool empty() const override;
+  int size() const override { return (int)events.size(); }
+
+  int get_partition_count() const { return (int)heaps.size(); }
+  // safe to call while other threads move slots between partitions
+  int get_partition(int i) const {
+    return owner[i].load(std::memory_order_relaxed);
+  }
+  // moves slot i into partition p, keeping its event
+  virtual void move(int i, int p);
+
+  /**
+   * the slots of partition p as a queue. it only takes updates of its own
+   * slots.
+   */
+  EventQueue &partition(int p) { return partitions[p]; }
+
+private:
+  class Partition : public EventQueue {
+  public:
+    Partition(PartitionedEventHeap *queue, int p) : queue(queue), p(p) {}
+
+    void update(int i, const Event &event) override {
+      queue->update(i, event);
+    }
+    const Event &top() const override;
+    int top_index() const override;
+    const Event &get(int i) const override { return queue->get(i); }
+    bool empty() const override;
+    int size() const override { return (int)queue->heaps[p].size(); }
+
+  private:
+    PartitionedEventHeap *queue;
+    int p;
+  };
+
+  std::vector<Event> events;           // pending event of each sphere
+  std::vector<std::atomic<int>> owner; // partition of each sphere
+  std::vector<int> position;           // position of each sphere in its heap
+  std::vector<std::vector<int>> heaps; // sphere indices of each partition
+  std::vector<Partition> partitions;
+
+  // the partition with the earliest top, -1 if all are without slots
+  int top_partition() const;
+};
+
+#endif // PARTITIONED_EVENT_HEAP_H
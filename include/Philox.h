@@ -0,0 +1,115 @@
+#ifndef PHILOX_H
+#define PHILOX_H
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+#include "vec3.h"
+
+/**
+ * Philox4x32-10, the counter based generator of Salmon et al. (Parallel
+ * random numbers: as easy as 1, 2, 3). a block of four random words is a
+ * function of a 128 bit counter and a 64 bit key alone, so any block can be
+ * made without making the ones before it.
+ */
+inline std::array<std::uint32_t, 4>
+philox4x32(std::array<std::uint32_t, 4> counter,
+           std::array<std::uint32_t, 2> key) {
+  for (int round = 0; round < 10; round++) {
+    std::uint64_t p0 = (std::uint64_t)0xD2511F53 * counter[0];
+    std::uint64_t p1 = (std::uint64_t)0xCD9E8D57 * counter[2];
+    counter = {(std::uint32_t)(p1 >> 32) ^ counter[1] ^ key[0],
+               (std::uint32_t)p1,
+               (std::uint32_t)(p0 >> 32) ^ counter[3] ^ key[1],
+               (std::uint32_t)p0};
+    key[0] += 0x9E3779B9;
+    key[1] += 0xBB67AE85;
+  }
+  return counter;
+}
+
+/**
+ * the random numbers of one stream, keyed by seed and counting along
+ * (index, block). streams of different indices never overlap, so every
+ * sphere can draw from a stream of its own, in any order and on any thread,
+ * and still get the same numbers. it is a uniform random bit generator, so
+ * the std distributions take it too.
+ */
+class PhiloxStream {
+public:
+  using result_type = std::uint64_t;
+
+  PhiloxStream(std::uint64_t seed, std::uint64_t index)
+      : key{(std::uint32_t)seed, (std::uint32_t)(seed >> 32)},
+        index(index) {}
+
+  static constexpr result_type min() { return 0; }
+  static constexpr result_type max() {
+    return std::numeric_limits<result_type>::max();
+  }
+
+  result_type operator()() {
+    if (this->used == 4) {
+      this->words = philox4x32({(std::uint32_t)this->block,
+                                (std::uint32_t)(this->block >> 32),
+                                (std::uint32_t)this->index,
+                                (std::uint32_t)(this->index >> 32)},
+                               this->key);
+      this->block++;
+      this->used = 0;
+    }
+    result_type bits = (result_type)this->words[this->used + 1] << 32 |
+                       this->words[this->used];
+    this->used += 2;
+    return bits;
+  }
+
+  // uniform in [0, 1), with the 53 bits a double holds
+  double uniform() { return ((*this)() >> 11) * 0x1.0p-53; }
+
+  // standard normal, by Box-Muller. the second value of a pair is kept
+  double normal() {
+    if (this->has_spare) {
+      this->has_spare = false;
+      return this->spare;
+    }
+    double radius = std::sqrt(-2 * std::log(1 - uniform()));
+    double angle = 6.283185307179586 * uniform();
+    this->spare = radius * std::sin(angle);
+    this->has_spare = true;
+    return radius * std::cos(angle);
+  }
+
+private:
+  std::array<std::uint32_t, 2> key;
+  std::uint64_t index;
+  std::uint64_t block = 0;
+  std::array<std::uint32_t, 4> words{};
+  int used = 4; // words of the current block already handed out
+
+  double spare = 0;
+  bool has_spare = false;
+};
+
+/**
+ * draws sphere index of a random start under seed: a center uniform on the
+ * unit torus and a direction of motion uniform on the sphere. it only
+ * depends on seed and index, so spheres can be drawn in parallel.
+ */
+template <typename Scalar, int Dim>
+void draw_sphere(std::uint64_t seed, std::uint64_t index,
+                 basic_point3<Scalar, Dim> &center,
+                 basic_vec3<Scalar, Dim> &velocity) {
+  PhiloxStream stream(seed, index);
+  for (int j = 0; j < Dim; j++) {
+    center[j] = (Scalar)stream.uniform();
+  }
+  for (int j = 0; j < Dim; j++) {
+    velocity[j] = (Scalar)stream.normal();
+  }
+  velocity.normalize();
+}
+
+#endif // PHILOX_H
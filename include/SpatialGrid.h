@@ -1,51 +1,380 @@
 #ifndef SPATIAL_GRID_H
 #define SPATIAL_GRID_H
 
+#include <array>
+#include <cstdint>
+#include <unordered_map>
 #include <vector>
 
+#include "CollisionKernel.h"
 #include "config.h"
 #include "Sphere.h"
+#include "SphereStore.h"
+#include "Stats.h"
+#include "Trace.h"
 #include "vec3.h"
 
 #define TORUS_SIZE 1.0
-#define MIN_CORNER point3::Zero()
-#define MAX_CORNER point3::Ones()
 
+/**
+ * An occupied cell. Its spheres form a doubly linked list threaded through
+ * per-sphere next/prev indices in the grid, so cells own no memory and
+ * spheres move between cells in constant time.
+ */
 struct GridCell {
-  std::vector<Sphere *> spheres;
+  int head = -1; // first sphere in the cell, -1 once it is empty
 };
 
-class SpatialGrid {
+constexpr int ipow(int base, int exp) {
+  return exp == 0 ? 1 : base * ipow(base, exp - 1);
+}
+
+/**
+ * offsets of the 3^Dim cells around a cell, the cell itself included, built
+ * at compile time so walking the neighbourhood needs no arithmetic.
+ */
+template <int Dim>
+constexpr std::array<std::array<int, Dim>, ipow(3, Dim)> make_stencil() {
+  std::array<std::array<int, Dim>, ipow(3, Dim)> stencil{};
+  for (int i = 0; i < ipow(3, Dim); i++) {
+    int k = i;
+    for (int j = 0; j < Dim; j++) {
+      stencil[i][j] = k % 3 - 1;
+      k /= 3;
+    }
+  }
+  return stencil;
+}
+
+/**
+ * Uniform grid over the torus that tracks which cell every sphere is in.
+ * Scalar is the floating point type of the sphere store and Dim the number
+ * of dimensions.
+ */
+template <typename Scalar, int Dim = DIMENSIONS> class BasicSpatialGrid {
 public:
-  SpatialGrid() = default;
-  SpatialGrid(long double cell_size, int grid_size, int sphere_count, double sphere_radius);
-  SpatialGrid(long double cell_size, int grid_size, int sphere_count, Sphere *spheres);
-  ~SpatialGrid();
+  BasicSpatialGrid() = default;
+  // sphere_count spheres placed at random, drawn from a fresh seed
+  BasicSpatialGrid(Scalar cell_size, int grid_size, int sphere_count, Scalar sphere_radius);
+  // the same, drawn from seed, see reset
+  BasicSpatialGrid(Scalar cell_size, int grid_size, int sphere_count, Scalar sphere_radius, std::uint64_t seed, int thread_count = THREAD_COUNT);
+  // takes ownership of spheres. they are copied into the sphere store and freed
+  BasicSpatialGrid(Scalar cell_size, int grid_size, int sphere_count, BasicSphere<Dim> *spheres);
+
+  /**
+   * places sphere_count spheres at random. sphere i is drawn from seed and i
+   * alone, see draw_sphere, so the spheres are drawn on thread_count threads
+   * and come out the same for any count. the memory of the grid before is
+   * reused.
+   */
+  void reset(Scalar cell_size, int grid_size, int sphere_count, Scalar sphere_radius, std::uint64_t seed, int thread_count = THREAD_COUNT);
+
+  /**
+   * calls visit(other) for every sphere in the cells around s, s included.
+   * walks the cells in place, so nothing is allocated or copied. the cells
+   * and spheres walked are counted into stats if given, here and in the
+   * other queries that take it.
+   */
+  template <typename Visitor> void for_each_nearby_sphere(int s, Visitor &&visit, SimulationStats *stats = nullptr);
+
+  /**
+   * calls visit(other) for the half of the neighbourhood of s that comes
+   * after s: spheres with a larger index in the home cell, and every sphere
+   * in the cells of the forward half of the stencil. doing this for every
+   * sphere visits each neighbouring pair once.
+   */
+  template <typename Visitor>
+  void for_each_forward_sphere(int s, Visitor &&visit, SimulationStats *stats = nullptr);
+
+  // same spheres as for_each_nearby_sphere, collected into a vector
+  std::vector<int> get_nearby_spheres(int s);
+
+  /**
+   * packs the spheres near s that can still collide into block for
+   * predict_collisions, projected to the local time of s.
+   */
+  void get_nearby_candidates(int s, CandidateBlock<Scalar, Dim> &block, SimulationStats *stats = nullptr);
+
+  /**
+   * appends other to block if it can still collide with s, projected to the
+   * local time of s.
+   */
+  void pack_candidate(int s, int other, CandidateBlock<Scalar, Dim> &block);
+
+  /**
+   * packs the spheres in others that can still collide into block, like
+   * get_nearby_candidates.
+   */
+  void pack_candidates(int s, const std::vector<int> &others,
+                       CandidateBlock<Scalar, Dim> &block);
+
+  /**
+   * advances a single sphere to time t and wraps it back onto the torus.
+   * spheres only change cells through transfer_sphere.
+   */
+  void advance_sphere(int s, Scalar t);
+
+  /**
+   * advances every sphere to time t. spheres carry their own local clocks, so
+   * this is only needed at sample points and at the end of a run.
+   */
+  void synchronize(Scalar t);
+
+  /**
+   * returns the time until s leaves its current cell along its current
+   * velocity, or infinity if it never does.
+   */
+  Scalar time_to_transfer(int s);
+
+  /**
+   * moves s into the cell it is leaving its current cell towards. s has to
+   * be advanced to the time of the transfer first. calls visit(other) for
+   * every sphere in the cells that have just become adjacent to s.
+   */
+  template <typename Visitor> void transfer_sphere(int s, Visitor &&visit, SimulationStats *stats = nullptr);
+
+  // same as above, with the new neighbours collected into a vector
+  std::vector<int> transfer_sphere(int s);
+
+  /**
+   * sorts the sphere store along a Morton curve through the cells, so
+   * spheres that are close in space are close in memory. returns the order
+   * applied: the sphere now at index i was at index order[i] before.
+   * indices into the store change, get_index keeps track of them.
+   */
+  std::vector<int> reorder();
+
+  /**
+   * returns the current store index of the sphere that was at index
+   * original when the grid was built. stays valid across reorder.
+   */
+  int get_index(int original) const { return sphere_index[original]; }
+
+  /**
+   * splits the torus into count slabs of cell columns along the first axis.
+   * every sector keeps its cells in a map of its own, so spheres in
+   * different sectors can be handled from different threads. sectors are at
+   * least three columns wide, so fewer than count may be made. returns the
+   * number of sectors.
+   */
+  int set_sector_count(int count);
+  int get_sector_count() const { return sector_count; }
+
+  // the sector of the cell s is registered in
+  int get_sector(int s) const {
+    return column_sector[sphere_cells[s] % grid_size];
+  }
+
+  /**
+   * returns true if the columns within margin of the one s is in all belong
+   * to its sector and none of them is on the border of the sector. handling
+   * such a sphere, or moving it by up to margin cells, then only reads and
+   * writes cells of its own sector. always true with a single sector.
+   */
+  bool in_sector_interior(int s, int margin = 0) const;
+
+  /**
+   * calls visit(sector) for the sectors of the columns within margin of the
+   * one s is in. a sector may be visited more than once.
+   */
+  template <typename Visitor>
+  void for_each_sector_near(int s, int margin, Visitor &&visit) const {
+    int x = sphere_cells[s] % grid_size;
+    int last = -1;
+    for (int k = -margin; k <= margin; k++) {
+      int sector = column_sector[((x + k) % grid_size + grid_size) % grid_size];
+      if (sector != last) {
+        visit(sector);
+        last = sector;
+      }
+    }
+  }
 
-  std::vector<Sphere *> get_nearby_spheres(Sphere *s);
-  void update_positions(long double dt);
-  // long double collide(Sphere *s1, Sphere *s2);
+  // the state of a sphere together with the cell it is registered in
+  struct SphereState {
+    typename BasicSphereStore<Scalar, Dim>::State state;
+    long long cell;
+  };
 
-  Sphere* get_spheres() const { return spheres; }
+  /**
+   * copies out the state of s, and puts it back, moving s back into the cell
+   * it was saved in.
+   */
+  SphereState save_sphere(int s) const;
+  void restore_sphere(int s, const SphereState &saved);
+
+  // linear index of the cell p lies in. p has to be on the torus
+  long long get_cell_index(const basic_point3<Scalar, Dim> &p);
+
+  BasicSphereStore<Scalar, Dim> &get_spheres() { return spheres; }
+  const BasicSphereStore<Scalar, Dim> &get_spheres() const { return spheres; }
+  size_t get_occupied_cell_count() const;
 
 private:
-  GridCell* grid;
-  Sphere* spheres;
-  long double cell_size;
-  int grid_size;
-  int sphere_count;
+  // the full neighbourhood of a cell, and one face of it for transfers
+  static constexpr std::array<std::array<int, Dim>, ipow(3, Dim)> stencil =
+      make_stencil<Dim>();
+  static constexpr std::array<std::array<int, Dim - 1>, ipow(3, Dim - 1)>
+      face_stencil = make_stencil<Dim - 1>();
+
+  // only occupied cells are stored, keyed by their linear cell index, so
+  // memory grows with the number of spheres rather than grid_size^d. one map
+  // per sector
+  std::vector<std::unordered_map<long long, GridCell>> grid;
+  int sector_count = 0;
+  std::vector<int> column_sector;  // sector of each column along axis 0
+  std::vector<bool> border_column; // first or last column of its sector
+  BasicSphereStore<Scalar, Dim> spheres;
+  Scalar cell_size = 0;
+  int grid_size = 0;
+  int sphere_count = 0;
+  std::vector<long long> sphere_cells; // cell each sphere is registered in
+  // store index of every sphere by its original index, and the reverse
+  std::vector<int> sphere_index;
+  std::vector<int> original_index;
+  // neighbours of each sphere in the list of its cell, -1 at either end
+  std::vector<int> next_in_cell;
+  std::vector<int> prev_in_cell;
+  long long strides[Dim] = {}; // grid_size^i, the step between cells along i
 
   // if the position is outside the grid, wrap it around
   // this can be used when getting neighboring cells
   // or when adding a sphere to the grid
-  void wrap_position(point3 *p); 
-  int get_cell_index(const point3 &p);
+  void wrap_position(int s); 
+  // cell index from integer cell coordinates, wrapped around the torus
+  long long get_cell_index(const int *cell_pos);
+  void get_cell_position(long long cell_index, int *cell_pos);
+  // interleaves the bits of the cell coordinates
+  unsigned long long morton_code(long long cell_index);
+  // the map of the sector the cell is in
+  inline std::unordered_map<long long, GridCell> &cells_of(long long cell_index) {
+    return grid[sector_count == 1 ? 0 : column_sector[cell_index % grid_size]];
+  }
+  // returns nullptr for empty cells
+  GridCell *find_cell(long long cell_index);
   
-  void add_sphere(Sphere *s);
-  void update_sphere(const point3 &old_pos, Sphere *s);
+  void add_sphere(int s);
+  void move_sphere(int s, long long new_cell_index);
+  // links s in at the head of the list of the cell, or unlinks it
+  void link_sphere(int s, long long cell_index);
+  void unlink_sphere(int s);
+
+  // calls visit(s) for every sphere in cell. stats is only read when
+  // COLLECT_STATS is set
+  template <typename Visitor>
+  inline void
+  for_each_in_cell(const GridCell &cell, Visitor &&visit,
+                   [[maybe_unused]] SimulationStats *stats = nullptr) const {
+    COUNT_STAT(if (stats != nullptr) { stats->cells_visited++; })
+    for (int s = cell.head; s >= 0; s = this->next_in_cell[s]) {
+      COUNT_STAT(if (stats != nullptr) { stats->spheres_in_visited_cells++; })
+      visit(s);
+    }
+  }
+
+  // calls visit(cell) for every occupied cell around cell_index
+  template <typename Visitor>
+  void for_each_nearby_cell(long long cell_index, Visitor &&visit);
 
-  std::vector<GridCell *> get_nearby_cells(int cell_index);
+  // moves s one cell along its exit axis and returns that axis. direction
+  // is set to the step taken, +1 or -1
+  int move_to_next_cell(int s, int &direction);
+
+  // time to leave the registered cell through each wall, per dimension
+  void exit_times(int s, Scalar *times);
 };
 
+template <typename Scalar, int Dim>
+template <typename Visitor>
+void BasicSpatialGrid<Scalar, Dim>::for_each_nearby_cell(long long cell_index,
+                                                         Visitor &&visit) {
+  int cell_pos[Dim];
+  get_cell_position(cell_index, cell_pos);
+
+  for (const auto &offset : stencil) {
+    // get the position of the neighboring cell
+    int neighbor_pos[Dim];
+    for (int j = 0; j < Dim; j++) {
+      neighbor_pos[j] = cell_pos[j] + offset[j];
+    }
+
+    // empty cells are not stored
+    GridCell *cell = find_cell(get_cell_index(neighbor_pos));
+    if (cell != nullptr) {
+      visit(*cell);
+    }
+  }
+}
+
+template <typename Scalar, int Dim>
+template <typename Visitor>
+void BasicSpatialGrid<Scalar, Dim>::for_each_nearby_sphere(
+    int s, Visitor &&visit, SimulationStats *stats) {
+  // the stencil includes the home cell
+  for_each_nearby_cell(sphere_cells[s], [&](GridCell &cell) {
+    for_each_in_cell(cell, visit, stats);
+  });
+}
+
+template <typename Scalar, int Dim>
+template <typename Visitor>
+void BasicSpatialGrid<Scalar, Dim>::for_each_forward_sphere(
+    int s, Visitor &&visit, SimulationStats *stats) {
+  TRACE_SCOPE("gather_neighbors");
+  long long cell_index = sphere_cells[s];
+
+  // pairs within the home cell are ordered by sphere index
+  for_each_in_cell(*find_cell(cell_index), [&](int other) {
+    if (other > s) {
+      visit(other);
+    }
+  }, stats);
+
+  // the stencil is point symmetric around the home cell in the middle, so
+  // the entries after it reach every neighbouring cell pair in one direction
+  int cell_pos[Dim];
+  get_cell_position(cell_index, cell_pos);
+
+  for (size_t i = stencil.size() / 2 + 1; i < stencil.size(); i++) {
+    int neighbor_pos[Dim];
+    for (int j = 0; j < Dim; j++) {
+      neighbor_pos[j] = cell_pos[j] + stencil[i][j];
+    }
+
+    GridCell *cell = find_cell(get_cell_index(neighbor_pos));
+    if (cell != nullptr) {
+      for_each_in_cell(*cell, visit, stats);
+    }
+  }
+}
+
+template <typename Scalar, int Dim>
+template <typename Visitor>
+void BasicSpatialGrid<Scalar, Dim>::transfer_sphere(int s, Visitor &&visit,
+                                                    SimulationStats *stats) {
+  TRACE_SCOPE("transfer_sphere");
+  int direction;
+  int axis = move_to_next_cell(s, direction);
+
+  int cell_pos[Dim];
+  get_cell_position(sphere_cells[s], cell_pos);
+
+  // the cells that just became adjacent form the face of the neighbourhood
+  // one step further along axis
+  for (const auto &offset : face_stencil) {
+    int neighbor_pos[Dim];
+    int k = 0;
+    for (int j = 0; j < Dim; j++) {
+      neighbor_pos[j] = cell_pos[j] + (j == axis ? direction : offset[k++]);
+    }
+
+    GridCell *cell = find_cell(get_cell_index(neighbor_pos));
+    if (cell != nullptr) {
+      for_each_in_cell(*cell, visit, stats);
+    }
+  }
+}
+
+using SpatialGrid = BasicSpatialGrid<long double>;
 
 #endif // SPATIAL_GRID_H
\ No newline at end of file
@@ -1,6 +1,7 @@
 #ifndef SPHERE_H
 #define SPHERE_H
 
+#include <atomic>
 #include <ostream>
 
 #include "config.h"
@@ -8,7 +9,7 @@
 
 struct UUID {
   int id;
-  UUID() {static int next_id = 0; id = next_id++;}
+  UUID() {static std::atomic<int> next_id(0); id = next_id++;}
   UUID(int id) : id(id) {}
   inline friend bool operator==(const UUID &u1, const UUID &u2) {
     return u1.id == u2.id;
@@ -18,12 +19,27 @@ struct UUID {
   }
 };
 
-class Sphere {
+template <int Dim> class BasicSphere;
+
+template <int Dim>
+double collide(const BasicSphere<Dim> *s1, const BasicSphere<Dim> *s2);
+template <int Dim>
+void resolve_collision(BasicSphere<Dim> *s1, BasicSphere<Dim> *s2);
+
+/**
+ * A sphere in Dim dimensions. Sphere is the sphere in the configured number
+ * of dimensions.
+ */
+template <int Dim> class BasicSphere {
 public:
-  Sphere() = default;
-  Sphere(double radius, point3 center, vec3 velocity)
-      : radius(fmax(0, radius)), center(center), velocity(velocity) {
+  using vec = basic_vec3<long double, Dim>;
+  using point = basic_point3<long double, Dim>;
+
+  BasicSphere() = default;
+  BasicSphere(double radius, point center, vec velocity)
+      : radius(fmax(0, radius)), center(center), velocity(velocity), time(0) {
     this->max_collision_checks = MAX_COLLISIONS_CHECKS;
+    this->collision_count = 0;
     this->id = UUID();
   }
 
@@ -36,12 +52,14 @@ public:
    * returns -1 if there is no collision, otherwise returns the time of
    * collision.
    */
-  friend double collide(const Sphere *s1, const Sphere *s2);
+  friend double collide<>(const BasicSphere *s1, const BasicSphere *s2);
 
   /**
-   * resolves the collision between two spheres. 
+   * resolves the collision between two spheres. both spheres have their
+   * collision counters bumped, which invalidates any event predicted for them
+   * before this collision.
   */
-  friend void resolve_collision(Sphere *s1, Sphere *s2);
+  friend void resolve_collision<>(BasicSphere *s1, BasicSphere *s2);
 
 
   /**
@@ -52,10 +70,18 @@ public:
   // vec3 collision_velocity(const Sphere *other);
 
   /**
-   * updates the position of the sphere by time dt.
+   * updates the position of the sphere by time dt and moves its local clock
+   * forward by the same amount.
    */
   void update_position(long double dt);
 
+  /**
+   * moves the sphere along its trajectory until its local clock reads t.
+   * spheres are only advanced when they take part in an event or are queried,
+   * so different spheres can be at different local times.
+   */
+  void advance_to(long double t);
+
   /**
    * decrements the number of collision checks left for the sphere.
    */
@@ -65,34 +91,50 @@ public:
   // vec3 toroidal_distance(const vec3& pos1, const vec3& pos2) const;
   // void wrap_around();
 
-  void set_velocity(vec3 v) { this->velocity = v; }
-  void set_position(point3 p) { this->center = p; }
+  void set_velocity(vec v) { this->velocity = v; }
+  void set_position(point p) { this->center = p; }
+  void set_time(long double t) { this->time = t; }
+  void set_max_collision_checks(int checks) {
+    this->max_collision_checks = checks;
+  }
+  void set_collision_count(int count) { this->collision_count = count; }
+  void set_id(int id) { this->id = UUID(id); }
 
-  vec3 &get_velocity() { return this->velocity; }
-  point3 &get_center() { return this->center; }
+  vec &get_velocity() { return this->velocity; }
+  const vec &get_velocity() const { return this->velocity; }
+  point &get_center() { return this->center; }
+  const point &get_center() const { return this->center; }
   // point3 *get_center() { return &this->center; }
-  int get_max_collision_checks() { return this->max_collision_checks; }
-  double get_radius() { return this->radius; }
-
-  inline friend std::ostream &operator<<(std::ostream &out, const Sphere &s) {
+  int get_max_collision_checks() const { return this->max_collision_checks; }
+  int get_collision_count() const { return this->collision_count; }
+  double get_radius() const { return this->radius; }
+  long double get_time() const { return this->time; }
+  int get_id() const { return this->id.id; }
+
+  inline friend std::ostream &operator<<(std::ostream &out,
+                                         const BasicSphere &s) {
     out << "sphere { radius: " << s.radius << ", center: " << s.center
         << ", velocity: " << s.velocity << ", " << s.max_collision_checks
         << " }";
     return out;
   }
-  inline friend bool operator==(const Sphere &s1, const Sphere &s2) {
+  inline friend bool operator==(const BasicSphere &s1, const BasicSphere &s2) {
     return s1.id == s2.id;
   }
-  inline friend bool operator!=(const Sphere &s1, const Sphere &s2) {
+  inline friend bool operator!=(const BasicSphere &s1, const BasicSphere &s2) {
     return s1.id != s2.id;
   }
 
 private:
   double radius;
-  point3 center;
-  vec3 velocity;
+  point center;
+  vec velocity;
+  long double time; // local clock, the time at which center is valid
   int max_collision_checks;
+  int collision_count; // number of collisions this sphere has taken part in
   UUID id;
 };
 
+using Sphere = BasicSphere<DIMENSIONS>;
+
 #endif
\ No newline at end of file
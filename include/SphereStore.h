@@ -0,0 +1,144 @@
+#ifndef SPHERE_STORE_H
+#define SPHERE_STORE_H
+
+#include <vector>
+
+#include "Sphere.h"
+#include "config.h"
+#include "vec3.h"
+
+template <typename Scalar, int Dim = DIMENSIONS> class BasicSphereStore;
+
+template <typename Scalar, int Dim>
+Scalar collide(const BasicSphereStore<Scalar, Dim> &spheres, int i, int j);
+template <typename Scalar, int Dim>
+void resolve_collision(BasicSphereStore<Scalar, Dim> &spheres, int i, int j);
+
+/**
+ * Structure-of-arrays storage for the spheres of a simulation. Every field
+ * that the collision search touches (centers, velocities, local clocks and
+ * counters) lives in its own contiguous array, one per dimension for the
+ * vectors, so scanning a neighbourhood streams through memory instead of
+ * striding over whole Sphere objects. The radius is shared when all spheres
+ * have the same one, and the ids are kept apart since they are only needed
+ * when spheres are handed back out as Sphere objects.
+ *
+ * Spheres are referred to by their index. Positions live on a torus of
+ * length torus_size, which collide and resolve_collision use to find the
+ * nearest image of the other sphere.
+ *
+ * Scalar is the floating point type positions, velocities and clocks are
+ * stored and computed in. It is instantiated for float, double and
+ * long double, in 2, 3 and 4 dimensions.
+ */
+template <typename Scalar, int Dim> class BasicSphereStore {
+public:
+  BasicSphereStore() = default;
+  // count spheres of the same radius, all at the origin and at rest
+  BasicSphereStore(int count, Scalar radius, Scalar torus_size);
+  // copies the spheres into the store
+  BasicSphereStore(int count, BasicSphere<Dim> *spheres, Scalar torus_size);
+
+  // the same as constructing it anew, but keeps the memory already allocated
+  void reset(int count, Scalar radius, Scalar torus_size);
+
+  inline int size() const { return this->count; }
+  inline Scalar get_torus_size() const { return this->torus_size; }
+
+  inline Scalar &center(int i, int d) { return this->centers[d][i]; }
+  inline Scalar center(int i, int d) const { return this->centers[d][i]; }
+  inline Scalar &velocity(int i, int d) { return this->velocities[d][i]; }
+  inline Scalar velocity(int i, int d) const {
+    return this->velocities[d][i];
+  }
+  inline Scalar &time(int i) { return this->times[i]; }
+  inline Scalar time(int i) const { return this->times[i]; }
+  inline int collision_count(int i) const {
+    return this->collision_counts[i];
+  }
+  inline int collision_checks(int i) const {
+    return this->collision_checks_left[i];
+  }
+  inline Scalar radius(int i) const {
+    return this->radii.empty() ? this->shared_radius : this->radii[i];
+  }
+
+  basic_point3<Scalar, Dim> get_center(int i) const;
+  basic_vec3<Scalar, Dim> get_velocity(int i) const;
+  void set_center(int i, const basic_point3<Scalar, Dim> &p);
+  void set_velocity(int i, const basic_vec3<Scalar, Dim> &v);
+
+  /**
+   * moves sphere i along its trajectory until its local clock reads t.
+   */
+  void advance_to(int i, Scalar t);
+
+  /**
+   * decrements the number of collision checks left for sphere i.
+   */
+  inline void decrement_collision_checks(int i) {
+    this->collision_checks_left[i]--;
+  }
+
+  // everything about one sphere that handling an event can change
+  struct State {
+    Scalar center[Dim];
+    Scalar velocity[Dim];
+    Scalar time;
+    int collision_count;
+    int collision_checks;
+  };
+
+  /**
+   * copies out the state of sphere i, and writes it back, e.g. to undo
+   * events that were handled too early.
+   */
+  State get_state(int i) const;
+  void set_state(int i, const State &state);
+
+  /**
+   * reorders the spheres so that sphere i becomes what sphere order[i] was.
+   * order has to be a permutation of the sphere indices.
+   */
+  void permute(const std::vector<int> &order);
+
+  /**
+   * returns sphere i as a standalone Sphere, e.g. for output or tests.
+   */
+  BasicSphere<Dim> get_sphere(int i) const;
+
+  /**
+   * returns the time until spheres i and j collide, measured from the later
+   * of their two local clocks, or -1 if they do not collide. the spheres do
+   * not have to be synchronized first, the earlier one is projected forward
+   * along its trajectory without being moved.
+   */
+  friend Scalar collide<>(const BasicSphereStore &spheres, int i, int j);
+
+  /**
+   * resolves the collision between spheres i and j, which have to be at the
+   * same local time. both spheres have their collision counters bumped.
+   */
+  friend void resolve_collision<>(BasicSphereStore &spheres, int i, int j);
+
+private:
+  int count = 0;
+  Scalar torus_size = 0;
+
+  // hot: read for every candidate pair
+  std::vector<Scalar> centers[Dim];
+  std::vector<Scalar> velocities[Dim];
+  std::vector<Scalar> times; // local clock, the time centers are valid
+  std::vector<int> collision_counts;
+  std::vector<int> collision_checks_left;
+
+  // cold
+  Scalar shared_radius = 0;
+  std::vector<Scalar> radii; // only filled if the radii differ
+  std::vector<int> ids;
+};
+
+// long double is kept as the reference precision
+using SphereStore = BasicSphereStore<long double>;
+
+#endif // SPHERE_STORE_H
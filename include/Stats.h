@@ -0,0 +1,82 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <algorithm>
+#include <ostream>
+
+#include "config.h"
+
+/**
+ * Counters of what a run spent its work on, to tell time in the queue from
+ * time in the grid and in the narrow phase. they are only kept when
+ * COLLECT_STATS is set and stay 0 otherwise, see COUNT_STAT.
+ */
+struct SimulationStats {
+  long events = 0;          // taken off the queue, stale ones included
+  long stale_events = 0;    // discarded because a sphere collided since
+  long rolled_back = 0;     // handled ahead of time by a sector, taken back
+  long collide_calls = 0;   // pair predictions, one per pair and image
+  long candidate_pairs = 0; // spheres looked at as partners of a sphere
+  long cell_migrations = 0; // spheres moved into another cell
+  long pending_events = 0;  // events in the queue right now
+  long peak_queue_size = 0; // most events in the queue at once
+  long cells_visited = 0;   // occupied cells walked by grid queries
+  long spheres_in_visited_cells = 0;
+
+  double spheres_per_visited_cell() const {
+    return cells_visited > 0 ? (double)spheres_in_visited_cells / cells_visited
+                             : 0;
+  }
+
+  // counts a pending event replaced by another one
+  void replace_pending(bool was_pending, bool is_pending) {
+    pending_events += (long)is_pending - (long)was_pending;
+    peak_queue_size = std::max(peak_queue_size, pending_events);
+  }
+
+  // counts a queue filled in one go
+  void set_pending(long count) {
+    pending_events = count;
+    peak_queue_size = std::max(peak_queue_size, pending_events);
+  }
+
+  /**
+   * adds the counts of other, which ran alongside this one. its pending
+   * events and its peak are taken as a change to the ones here.
+   */
+  void merge(const SimulationStats &other) {
+    events += other.events;
+    stale_events += other.stale_events;
+    rolled_back += other.rolled_back;
+    collide_calls += other.collide_calls;
+    candidate_pairs += other.candidate_pairs;
+    cell_migrations += other.cell_migrations;
+    cells_visited += other.cells_visited;
+    spheres_in_visited_cells += other.spheres_in_visited_cells;
+    peak_queue_size =
+        std::max(peak_queue_size, pending_events + other.peak_queue_size);
+    pending_events += other.pending_events;
+    peak_queue_size = std::max(peak_queue_size, pending_events);
+  }
+
+  void write_json(std::ostream &out) const {
+    out << "{\"events\": " << events << ", \"stale_events\": " << stale_events
+        << ", \"rolled_back\": " << rolled_back
+        << ", \"collide_calls\": " << collide_calls
+        << ", \"candidate_pairs\": " << candidate_pairs
+        << ", \"cell_migrations\": " << cell_migrations
+        << ", \"peak_queue_size\": " << peak_queue_size
+        << ", \"cells_visited\": " << cells_visited
+        << ", \"spheres_per_visited_cell\": " << spheres_per_visited_cell()
+        << "}" << std::endl;
+  }
+};
+
+// the statement, only when stats are collected. commas are fine
+#if COLLECT_STATS
+#define COUNT_STAT(...) __VA_ARGS__
+#else
+#define COUNT_STAT(...)
+#endif
+
+#endif // STATS_H
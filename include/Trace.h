@@ -0,0 +1,168 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+#include "config.h"
+
+/**
+ * Timeline of the phases of a run, one track per thread, written as Chrome
+ * trace event JSON, which Perfetto (ui.perfetto.dev) and chrome://tracing
+ * open. spans come from TraceScope, usually through TRACE_SCOPE and
+ * TRACE_PHASE, and are only recorded between start and stop.
+ *
+ * phases are recorded whole. the hot path scopes are sampled: of the
+ * outermost sampled scopes a thread opens only every sampling-th is
+ * recorded, together with everything nested in it, so a recorded event
+ * still shows where its time went.
+ */
+class Tracer {
+public:
+  // what a thread has recorded. only the thread itself writes to it
+  struct Thread {
+    struct Span {
+      const char *name;
+      double start; // microseconds since start
+      double duration;
+    };
+
+    int id;
+    std::vector<Span> spans;
+    int skip = 0;          // outermost sampled scopes left to skip
+    int sampled_depth = 0; // sampled scopes open right now
+    bool sampled = false;  // whether the outermost one is recorded
+  };
+
+  static Tracer &get() { return instance; }
+
+  /**
+   * starts recording, after dropping what was recorded before. 1 records
+   * every sampled scope, higher values every sampling-th. must not be called
+   * while other threads record.
+   */
+  void start(int sampling = 1);
+  void stop() { recording.store(false, std::memory_order_relaxed); }
+  bool is_recording() const {
+    return recording.load(std::memory_order_relaxed);
+  }
+  int get_sampling() const { return sampling; }
+
+  // spans recorded since start
+  long size() const;
+
+  /**
+   * writes the spans as trace event JSON. must not be called while other
+   * threads record.
+   */
+  void write_json(std::ostream &out) const;
+
+  // microseconds since start
+  double now() const {
+    return std::chrono::duration<double, std::micro>(
+               std::chrono::steady_clock::now() - origin)
+        .count();
+  }
+
+  // the track of the calling thread
+  Thread &thread() {
+    Thread *&current = current_thread();
+    if (current == nullptr) {
+      current = this->acquire();
+    }
+    return *current;
+  }
+
+private:
+  Tracer() = default;
+
+  static Tracer instance;
+
+  // the track the calling thread holds, set once it first records
+  static Thread *&current_thread() {
+    static thread_local Thread *current = nullptr;
+    return current;
+  }
+
+  // hands a thread the lowest track no running thread holds, so the threads
+  // parallel_for starts again every round land on the same tracks. it is
+  // handed back when the thread exits
+  Thread *acquire();
+  void release(Thread *thread);
+
+  std::atomic<bool> recording{false};
+  int sampling = 1;
+  std::chrono::steady_clock::time_point origin;
+
+  mutable std::mutex mutex;
+  std::vector<std::unique_ptr<Thread>> threads;
+  std::vector<Thread *> free_threads;
+};
+
+// times the enclosing scope on the track of the calling thread
+class TraceScope {
+public:
+  explicit TraceScope(const char *name, bool sampled = true)
+      : name(name), sampled(sampled) {
+    Tracer &tracer = Tracer::get();
+    if (!tracer.is_recording()) {
+      return;
+    }
+
+    this->thread = &tracer.thread();
+    if (sampled) {
+      if (this->thread->sampled_depth++ == 0) {
+        this->thread->sampled = this->thread->skip == 0;
+        this->thread->skip = this->thread->sampled
+                                 ? tracer.get_sampling() - 1
+                                 : this->thread->skip - 1;
+      }
+      if (!this->thread->sampled) {
+        return;
+      }
+    }
+    this->start = tracer.now();
+    this->recorded = true;
+  }
+
+  ~TraceScope() {
+    if (this->thread == nullptr) {
+      return;
+    }
+    if (this->recorded) {
+      this->thread->spans.push_back(
+          {this->name, this->start, Tracer::get().now() - this->start});
+    }
+    if (this->sampled) {
+      this->thread->sampled_depth--;
+    }
+  }
+
+  TraceScope(const TraceScope &) = delete;
+  TraceScope &operator=(const TraceScope &) = delete;
+
+private:
+  const char *name;
+  bool sampled;
+  bool recorded = false;
+  double start = 0;
+  Tracer::Thread *thread = nullptr;
+};
+
+// the scope, only when traces are collected. TRACE_PHASE is never sampled
+#if COLLECT_TRACE
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+#define TRACE_PHASE(name)                                                      \
+  TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(name, false)
+#else
+#define TRACE_SCOPE(name)
+#define TRACE_PHASE(name)
+#endif
+
+#endif // TRACE_H
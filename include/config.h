@@ -4,5 +4,26 @@
 #define DIMENSIONS 3
 #define MAX_COLLISIONS_CHECKS 1
 #define MAX_SIMULATION_TIME 1.0
+// events between reorderings of the sphere storage along a space-filling
+// curve. 0 turns reordering off
+#define REORDER_INTERVAL 100000
+// threads used to predict the initial events. 0 uses one per hardware thread
+#define THREAD_COUNT 0
+// sectors the torus is split into, each run on its own thread. 1 runs serially
+// and 0 uses one per hardware thread
+#define SECTOR_COUNT 1
+// events a time warp sector handles between dropping the undo records that
+// can not be taken back anymore
+#define COMMIT_INTERVAL 256
+// 1 counts what runs spend their work on, see Stats.h. 0 compiles the
+// counting out. can also be set with the SPHERESIM_STATS cmake option
+#ifndef COLLECT_STATS
+#define COLLECT_STATS 0
+#endif
+// 1 compiles in the phase timers, see Trace.h. they still only record once
+// Tracer::start is called. can also be set with the SPHERESIM_TRACE option
+#ifndef COLLECT_TRACE
+#define COLLECT_TRACE 0
+#endif
 
 #endif // CONFIG_H
\ No newline at end of file
@@ -0,0 +1,97 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "config.h"
+
+/**
+ * the number of threads a thread_count setting stands for. anything below 1
+ * means one per hardware thread, see THREAD_COUNT.
+ */
+inline int resolve_thread_count(int thread_count) {
+  if (thread_count > 0) {
+    return thread_count;
+  }
+  return std::max(1, (int)std::thread::hardware_concurrency());
+}
+
+/**
+ * splits [0, n) into one contiguous chunk per thread and calls
+ * f(thread, begin, end) for every chunk, each on its own thread. chunks are
+ * in order, so chunk t only holds indices below those of chunk t + 1. the
+ * calling thread runs the first chunk itself and returns once all of them
+ * are done.
+ */
+template <typename F> void parallel_for(int n, int thread_count, F &&f) {
+  int threads = std::max(1, std::min(resolve_thread_count(thread_count), n));
+  if (threads == 1) {
+    f(0, 0, n);
+    return;
+  }
+
+  std::vector<std::thread> workers;
+  workers.reserve(threads - 1);
+  for (int t = 1; t < threads; t++) {
+    int begin = (int)((long long)n * t / threads);
+    int end = (int)((long long)n * (t + 1) / threads);
+    workers.emplace_back([&f, t, begin, end]() { f(t, begin, end); });
+  }
+
+  f(0, 0, (int)((long long)n / threads));
+
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+}
+
+/**
+ * lets a fixed number of threads wait for each other, as often as needed, so
+ * threads that stay up for many short rounds of work can keep in step
+ * without being started again every round. the last one to arrive lets all
+ * of them go on.
+ */
+class Barrier {
+public:
+  explicit Barrier(int threads) : threads(threads) {}
+
+  void arrive_and_wait() {
+    long round = this->round.load(std::memory_order_acquire);
+    if (this->arrived.fetch_add(1, std::memory_order_acq_rel) + 1 ==
+        this->threads) {
+      this->arrived.store(0, std::memory_order_relaxed);
+      {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->round.store(round + 1, std::memory_order_release);
+      }
+      this->next_round.notify_all();
+      return;
+    }
+
+    // rounds are short, so the others are usually not far behind
+    for (int spin = 0; spin < 1000; spin++) {
+      if (this->round.load(std::memory_order_acquire) != round) {
+        return;
+      }
+      std::this_thread::yield();
+    }
+    std::unique_lock<std::mutex> lock(this->mutex);
+    this->next_round.wait(lock, [&]() {
+      return this->round.load(std::memory_order_acquire) != round;
+    });
+  }
+
+private:
+  int threads;
+  std::atomic<int> arrived{0};
+  std::atomic<long> round{0};
+  std::mutex mutex;
+  std::condition_variable next_round;
+};
+
+#endif // PARALLEL_H
@@ -1,38 +1,69 @@
 #ifndef SPHERE_SIMULATION_H
 #define SPHERE_SIMULATION_H
 
-#include <queue>
+#include <cstdint>
+#include <memory>
+#include <ostream>
 #include <vector>
 
+#include "CollisionKernel.h"
+#include "Event.h"
+#include "EventQueue.h"
 #include "Sphere.h"
-
-struct Event {
-  long double time;
-  Sphere *s1;
-  Sphere *s2;
-
-  bool operator<(const Event &other) const {
-    return time > other.time; // for min-heap
-  }
-  Event(long double time, Sphere *s1, Sphere *s2)
-      : time(time), s1(s1), s2(s2) {}
-};
+#include "Stats.h"
+#include "config.h"
 
 class sphere_simulation {
 public:
-  sphere_simulation(int n);
-  sphere_simulation(int n, Sphere *spheres);
+  sphere_simulation(int n, QueueType queue_type = QueueType::HEAP);
+  /**
+   * about n spheres drawn from seed. sphere i only depends on seed and i, see
+   * draw_sphere, and gets id i, so they are drawn on thread_count threads and
+   * come out the same for any number of them.
+   */
+  sphere_simulation(int n, std::uint64_t seed,
+                    QueueType queue_type = QueueType::HEAP,
+                    int thread_count = THREAD_COUNT);
+  sphere_simulation(int n, Sphere *spheres,
+                    QueueType queue_type = QueueType::HEAP);
   ~sphere_simulation();
 
   void run_simulation();
   void run_simulation_step();
   void initialize_events();
 
+  /**
+   * advances every sphere to the current time. spheres keep their own local
+   * clock and are only moved when they take part in an event, so this has to
+   * be called before reading positions mid-run.
+   */
+  void synchronize();
+
   inline Sphere *get_spheres() const { return spheres; }
   inline int get_number_of_spheres() const { return number_of_spheres; }
   inline const std::vector<long double> get_collision_times() const {
     return collision_times;
   }
+  // events handled so far, stale ones included
+  inline long get_event_count() const { return events; }
+  inline long get_stale_event_count() const { return stale_events; }
+
+  /**
+   * what the run so far spent its work on, see SimulationStats. apart from
+   * the event counts it is only kept when COLLECT_STATS is set. every other
+   * sphere is a candidate pair, there is no grid here.
+   */
+  inline SimulationStats get_stats() const {
+    SimulationStats counts = stats;
+    counts.events = events;
+    counts.stale_events = stale_events;
+    return counts;
+  }
+  // run_simulation writes get_stats to out as JSON once done. nullptr for none
+  inline void set_stats_output(std::ostream *out) { stats_output = out; }
+
+  // threads initialize_events predicts on, 0 for one per hardware thread
+  inline void set_thread_count(int count) { thread_count = count; }
 
   inline friend std::ostream &operator<<(std::ostream &out,
                                          const sphere_simulation &s) {
@@ -45,8 +76,11 @@ public:
 private:
   // data structs
   std::vector<long double> collision_times; // stores the collision times
-  std::priority_queue<Event> event_queue;
+  std::unique_ptr<EventQueue> event_queue; // next event of every sphere
   Sphere *spheres;
+  // the other spheres packed for the collision kernel, reused between calls
+  CandidateBlock<double> candidates;
+  std::vector<double> candidate_times;
 
   // simulation parameters
   long double max_time;
@@ -54,14 +88,26 @@ private:
   int number_of_spheres;
   double torus_size;
   double epsilon; // radius
+  long events = 0;
+  long stale_events = 0; // events discarded because a sphere collided since
+  SimulationStats stats;
+  std::ostream *stats_output = nullptr;
+  int thread_count = THREAD_COUNT;
 
   // functions
   void handle_event(Event &event);
-  void add_collision_event(Sphere *s1, Sphere *s2);
   void find_collision_events(Sphere *s1);
+  // the earliest collision of s1 with any other sphere, all of which have to
+  // be at the current time. only reads the spheres
+  Event predict_next_event(const Sphere *s1,
+                           CandidateBlock<double> &candidates,
+                           std::vector<double> &candidate_times,
+                           SimulationStats &stats) const;
   void wrap_around(Sphere *s);
-  void update_positions(long double dt);
-  std::vector<point3> get_images(Sphere *s);
+  void nearest_image(Sphere *s, Sphere *other);
+  void advance_sphere(Sphere *s);
+  inline int index_of(const Sphere *s) const { return (int)(s - spheres); }
+  std::vector<point3> get_images(const Sphere *s) const;
 };
 
 #endif
\ No newline at end of file
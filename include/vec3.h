@@ -7,4 +7,10 @@
 using vec3 = Eigen::Vector<long double, DIMENSIONS>;
 using point3 = Eigen::Vector<long double, DIMENSIONS>;
 
+// vectors of the scalar type and dimension an engine is instantiated with
+template <typename Scalar, int Dim = DIMENSIONS>
+using basic_vec3 = Eigen::Vector<Scalar, Dim>;
+template <typename Scalar, int Dim = DIMENSIONS>
+using basic_point3 = Eigen::Vector<Scalar, Dim>;
+
 #endif
\ No newline at end of file
@@ -0,0 +1,219 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "CalendarQueue.h"
+
+// smallest calendar we shrink down to
+#define MIN_BUCKETS 2
+
+CalendarQueue::CalendarQueue(int size)
+    : events(size), buckets(MIN_BUCKETS), bucket_of(size, -1),
+      slot_of(size, -1) {}
+
+void CalendarQueue::update(int i, const Event &event) {
+  if (this->bucket_of[i] != -1) {
+    erase(i);
+  }
+
+  this->events[i] = event;
+  this->cached_top = -1;
+
+  if (std::isinf(event.time)) {
+    return;
+  }
+
+  // events are not expected before the last one handed out, but if one shows
+  // up the search has to start from it
+  if (event.time < this->last_time) {
+    this->last_time = event.time;
+  }
+
+  insert(i);
+  maybe_resize();
+}
+
+void CalendarQueue::assign(const std::vector<Event> &events) {
+  int n = (int)events.size();
+  this->events = events;
+  this->bucket_of.assign(n, -1);
+  this->slot_of.assign(n, -1);
+  this->cached_top = -1;
+
+  int active = 0;
+  long double min_time = INFINITY, max_time = -INFINITY;
+  for (const Event &event : events) {
+    if (!std::isinf(event.time)) {
+      active++;
+      min_time = std::min(min_time, event.time);
+      max_time = std::max(max_time, event.time);
+    }
+  }
+  if (min_time < this->last_time) {
+    this->last_time = min_time;
+  }
+
+  // the size maybe_resize would have grown to, with the width from the
+  // spacing seen so far or else the spread of the new events
+  int bucket_count = MIN_BUCKETS;
+  while (active > 2 * bucket_count) {
+    bucket_count *= 2;
+  }
+  long double bucket_width = this->width;
+  if (this->gap_samples > 0) {
+    bucket_width = 3 * this->mean_gap;
+  } else if (max_time > min_time) {
+    bucket_width = 3 * (max_time - min_time) / active;
+  }
+
+  this->buckets.assign(bucket_count, std::vector<int>());
+  this->width = bucket_width > 0 ? bucket_width : this->width;
+  this->active = 0;
+  this->searches = 0;
+  for (int i = 0; i < n; i++) {
+    if (!std::isinf(events[i].time)) {
+      insert(i);
+    }
+  }
+}
+
+const Event &CalendarQueue::top() const { return this->events[top_index()]; }
+
+int CalendarQueue::top_index() const {
+  if (this->cached_top == -1) {
+    this->cached_top = search();
+  }
+  return this->cached_top;
+}
+
+int CalendarQueue::bucket_index(long double time) const {
+  long long nb = (long long)this->buckets.size();
+  long long day = (long long)floorl(time / this->width);
+  return (int)(((day % nb) + nb) % nb);
+}
+
+void CalendarQueue::insert(int i) {
+  int b = bucket_index(this->events[i].time);
+  this->bucket_of[i] = b;
+  this->slot_of[i] = (int)this->buckets[b].size();
+  this->buckets[b].push_back(i);
+  this->active++;
+}
+
+void CalendarQueue::erase(int i) {
+  // swap the last entry of the bucket into the hole
+  std::vector<int> &bucket = this->buckets[this->bucket_of[i]];
+  int last = bucket.back();
+  bucket[this->slot_of[i]] = last;
+  this->slot_of[last] = this->slot_of[i];
+  bucket.pop_back();
+
+  this->bucket_of[i] = -1;
+  this->slot_of[i] = -1;
+  this->active--;
+}
+
+int CalendarQueue::search() const {
+  if (this->active == 0) {
+    // every slot is empty, any of them will do
+    return 0;
+  }
+
+  int nb = (int)this->buckets.size();
+  long long day = (long long)floorl(this->last_time / this->width);
+  int best = -1;
+
+  // walk one year forward from the day of the last event, the first bucket
+  // holding an event inside its current day has the earliest event
+  for (int k = 0; k < nb && best == -1; k++) {
+    const std::vector<int> &bucket = this->buckets[(day + k) % nb];
+
+    for (int i : bucket) {
+      long double t = this->events[i].time;
+      bool today = (long long)floorl(t / this->width) <= day + k;
+      if (today && (best == -1 || t < this->events[best].time)) {
+        best = i;
+      }
+    }
+  }
+
+  // nothing within a year, fall back to a direct search
+  if (best == -1) {
+    for (const std::vector<int> &bucket : this->buckets) {
+      for (int i : bucket) {
+        if (best == -1 || this->events[i].time < this->events[best].time) {
+          best = i;
+        }
+      }
+    }
+  }
+
+  // track the spacing of successive events for the bucket width
+  long double gap = this->events[best].time - this->last_time;
+  if (gap > 0) {
+    this->mean_gap = this->gap_samples == 0
+                         ? gap
+                         : this->mean_gap + (gap - this->mean_gap) / 16;
+    this->gap_samples++;
+  }
+  this->last_time = this->events[best].time;
+  this->searches++;
+
+  return best;
+}
+
+void CalendarQueue::resize(int bucket_count, long double bucket_width) {
+  std::vector<int> pending;
+  pending.reserve(this->active);
+  for (const std::vector<int> &bucket : this->buckets) {
+    pending.insert(pending.end(), bucket.begin(), bucket.end());
+  }
+
+  this->buckets.assign(bucket_count, std::vector<int>());
+  this->width = bucket_width;
+  this->active = 0;
+  this->searches = 0;
+
+  for (int i : pending) {
+    insert(i);
+  }
+}
+
+void CalendarQueue::maybe_resize() {
+  int nb = (int)this->buckets.size();
+  int bucket_count = nb;
+
+  if (this->active > 2 * nb) {
+    bucket_count = 2 * nb;
+  } else if (this->active < nb / 2 && nb > MIN_BUCKETS) {
+    bucket_count = nb / 2;
+  }
+
+  // about three events per day works best (Brown, 1988). before any events
+  // have been handed out, estimate the spacing from the pending events.
+  long double bucket_width = this->width;
+  if (this->gap_samples > 0) {
+    bucket_width = 3 * this->mean_gap;
+  } else if (bucket_count != nb) {
+    long double min_time = INFINITY, max_time = -INFINITY;
+    for (const std::vector<int> &bucket : this->buckets) {
+      for (int i : bucket) {
+        min_time = std::min(min_time, this->events[i].time);
+        max_time = std::max(max_time, this->events[i].time);
+      }
+    }
+    if (max_time > min_time) {
+      bucket_width = 3 * (max_time - min_time) / this->active;
+    }
+  }
+
+  // the width is only recalibrated once per pass over the calendar, and only
+  // if it is far off, so rebuilding stays O(1) amortised
+  bool width_off = this->searches > nb &&
+                   (bucket_width > 2 * this->width ||
+                    bucket_width < this->width / 2);
+
+  if (bucket_count != nb || width_off) {
+    resize(bucket_count, bucket_width > 0 ? bucket_width : this->width);
+  }
+}
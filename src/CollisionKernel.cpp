@@ -0,0 +1,265 @@
+#include <cmath>
+#include <type_traits>
+
+#include "CollisionKernel.h"
+#include "config.h"
+
+// the SIMD kernels are compiled for their instruction set with target
+// pragmas, so the rest of the program does not need any -m flags and the
+// kernel is picked when the program runs
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define SIMD_KERNELS
+#include <immintrin.h>
+#endif
+
+namespace {
+
+template <typename Scalar, int Dim>
+void predict_scalar(const Scalar *center, const Scalar *velocity,
+                    Scalar radius, Scalar torus_size,
+                    const CandidateBlock<Scalar, Dim> &block, int begin,
+                    Scalar *times) {
+  for (int k = begin; k < block.size(); k++) {
+    Scalar vv = 0, vx = 0, xx = 0;
+    for (int d = 0; d < Dim; d++) {
+      Scalar v = block.velocity[d][k] - velocity[d];
+      Scalar x = block.center[d][k] - center[d];
+      // nearest image of the candidate
+      if (torus_size > 0) {
+        x -= torus_size * std::floor(x / torus_size + Scalar(0.5));
+      }
+      vv += v * v;
+      vx += v * x;
+      xx += x * x;
+    }
+
+    Scalar combined_radius = radius + block.radius[k];
+
+    Scalar a = vv;
+    Scalar b = 2 * vx;
+    Scalar c = xx - combined_radius * combined_radius;
+
+    Scalar discriminant = b * b - 4 * a * c;
+
+    if (discriminant < 0) {
+      // No real roots, so no collision
+      times[k] = -1;
+      continue;
+    }
+
+    Scalar t1 = (-b - std::sqrt(discriminant)) / (2 * a);
+    times[k] = t1 >= 0 ? t1 : -1;
+  }
+}
+
+#ifdef SIMD_KERNELS
+
+// fused multiply-adds would round differently from the scalar kernel
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#if !defined(__clang__)
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+namespace avx2 {
+
+template <typename Scalar> struct Ops;
+
+template <> struct Ops<double> {
+  using V = __m256d;
+  static const int width = 4;
+  static inline V load(const double *p) { return _mm256_loadu_pd(p); }
+  static inline void store(double *p, V x) { _mm256_storeu_pd(p, x); }
+  static inline V set1(double x) { return _mm256_set1_pd(x); }
+  static inline V add(V x, V y) { return _mm256_add_pd(x, y); }
+  static inline V sub(V x, V y) { return _mm256_sub_pd(x, y); }
+  static inline V mul(V x, V y) { return _mm256_mul_pd(x, y); }
+  static inline V div(V x, V y) { return _mm256_div_pd(x, y); }
+  static inline V sqrt(V x) { return _mm256_sqrt_pd(x); }
+  static inline V floor(V x) { return _mm256_floor_pd(x); }
+  // t where the discriminant and t are both non-negative, otherwise other
+  static inline V select(V discriminant, V t, V other) {
+    V zero = _mm256_setzero_pd();
+    V mask = _mm256_and_pd(_mm256_cmp_pd(discriminant, zero, _CMP_GE_OQ),
+                           _mm256_cmp_pd(t, zero, _CMP_GE_OQ));
+    return _mm256_blendv_pd(other, t, mask);
+  }
+};
+
+template <> struct Ops<float> {
+  using V = __m256;
+  static const int width = 8;
+  static inline V load(const float *p) { return _mm256_loadu_ps(p); }
+  static inline void store(float *p, V x) { _mm256_storeu_ps(p, x); }
+  static inline V set1(float x) { return _mm256_set1_ps(x); }
+  static inline V add(V x, V y) { return _mm256_add_ps(x, y); }
+  static inline V sub(V x, V y) { return _mm256_sub_ps(x, y); }
+  static inline V mul(V x, V y) { return _mm256_mul_ps(x, y); }
+  static inline V div(V x, V y) { return _mm256_div_ps(x, y); }
+  static inline V sqrt(V x) { return _mm256_sqrt_ps(x); }
+  static inline V floor(V x) { return _mm256_floor_ps(x); }
+  static inline V select(V discriminant, V t, V other) {
+    V zero = _mm256_setzero_ps();
+    V mask = _mm256_and_ps(_mm256_cmp_ps(discriminant, zero, _CMP_GE_OQ),
+                           _mm256_cmp_ps(t, zero, _CMP_GE_OQ));
+    return _mm256_blendv_ps(other, t, mask);
+  }
+};
+
+#include "CollisionKernelSimd.inc"
+
+} // namespace avx2
+
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+#if !defined(__clang__)
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+namespace avx512 {
+
+// sqrt and floor go through the masked intrinsics with every lane set and a
+// zero source. the plain ones pass gcc an undefined source vector, which it
+// reports as maybe uninitialized
+
+template <typename Scalar> struct Ops;
+
+template <> struct Ops<double> {
+  using V = __m512d;
+  static const int width = 8;
+  static inline V load(const double *p) { return _mm512_loadu_pd(p); }
+  static inline void store(double *p, V x) { _mm512_storeu_pd(p, x); }
+  static inline V set1(double x) { return _mm512_set1_pd(x); }
+  static inline V add(V x, V y) { return _mm512_add_pd(x, y); }
+  static inline V sub(V x, V y) { return _mm512_sub_pd(x, y); }
+  static inline V mul(V x, V y) { return _mm512_mul_pd(x, y); }
+  static inline V div(V x, V y) { return _mm512_div_pd(x, y); }
+  static inline V sqrt(V x) {
+    return _mm512_mask_sqrt_pd(_mm512_setzero_pd(), (__mmask8)-1, x);
+  }
+  static inline V floor(V x) {
+    return _mm512_mask_roundscale_pd(_mm512_setzero_pd(), (__mmask8)-1, x,
+                                     _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+  }
+  static inline V select(V discriminant, V t, V other) {
+    V zero = _mm512_setzero_pd();
+    __mmask8 mask = _mm512_cmp_pd_mask(discriminant, zero, _CMP_GE_OQ) &
+                    _mm512_cmp_pd_mask(t, zero, _CMP_GE_OQ);
+    return _mm512_mask_blend_pd(mask, other, t);
+  }
+};
+
+template <> struct Ops<float> {
+  using V = __m512;
+  static const int width = 16;
+  static inline V load(const float *p) { return _mm512_loadu_ps(p); }
+  static inline void store(float *p, V x) { _mm512_storeu_ps(p, x); }
+  static inline V set1(float x) { return _mm512_set1_ps(x); }
+  static inline V add(V x, V y) { return _mm512_add_ps(x, y); }
+  static inline V sub(V x, V y) { return _mm512_sub_ps(x, y); }
+  static inline V mul(V x, V y) { return _mm512_mul_ps(x, y); }
+  static inline V div(V x, V y) { return _mm512_div_ps(x, y); }
+  static inline V sqrt(V x) {
+    return _mm512_mask_sqrt_ps(_mm512_setzero_ps(), (__mmask16)-1, x);
+  }
+  static inline V floor(V x) {
+    return _mm512_mask_roundscale_ps(_mm512_setzero_ps(), (__mmask16)-1, x,
+                                     _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+  }
+  static inline V select(V discriminant, V t, V other) {
+    V zero = _mm512_setzero_ps();
+    __mmask16 mask = _mm512_cmp_ps_mask(discriminant, zero, _CMP_GE_OQ) &
+                     _mm512_cmp_ps_mask(t, zero, _CMP_GE_OQ);
+    return _mm512_mask_blend_ps(mask, other, t);
+  }
+};
+
+#include "CollisionKernelSimd.inc"
+
+} // namespace avx512
+
+#pragma GCC pop_options
+
+#endif // SIMD_KERNELS
+
+KernelType best_kernel_type() {
+  if (kernel_supported(KernelType::AVX512)) {
+    return KernelType::AVX512;
+  }
+  if (kernel_supported(KernelType::AVX2)) {
+    return KernelType::AVX2;
+  }
+  return KernelType::SCALAR;
+}
+
+KernelType &selected_kernel_type() {
+  static KernelType type = best_kernel_type();
+  return type;
+}
+
+} // namespace
+
+bool kernel_supported(KernelType type) {
+#ifdef SIMD_KERNELS
+  __builtin_cpu_init();
+  switch (type) {
+  case KernelType::AVX512:
+    return __builtin_cpu_supports("avx512f");
+  case KernelType::AVX2:
+    return __builtin_cpu_supports("avx2");
+  default:
+    return true;
+  }
+#else
+  return type == KernelType::SCALAR;
+#endif
+}
+
+KernelType get_kernel_type() { return selected_kernel_type(); }
+
+void set_kernel_type(KernelType type) {
+  selected_kernel_type() = kernel_supported(type) ? type : KernelType::SCALAR;
+}
+
+template <typename Scalar, int Dim>
+void predict_collisions(const Scalar *center, const Scalar *velocity,
+                        Scalar radius, Scalar torus_size,
+                        const CandidateBlock<Scalar, Dim> &block,
+                        Scalar *times) {
+  int done = 0;
+#ifdef SIMD_KERNELS
+  // there are no SIMD kernels for long double
+  if constexpr (!std::is_same<Scalar, long double>::value) {
+    switch (get_kernel_type()) {
+    case KernelType::AVX512:
+      done =
+          avx512::predict(center, velocity, radius, torus_size, block, times);
+      break;
+    case KernelType::AVX2:
+      done = avx2::predict(center, velocity, radius, torus_size, block, times);
+      break;
+    default:
+      break;
+    }
+  }
+#endif
+  // whatever does not fill a whole vector
+  predict_scalar(center, velocity, radius, torus_size, block, done, times);
+}
+
+#define INSTANTIATE_PREDICT_COLLISIONS(Scalar, Dim)                           \
+  template void predict_collisions(const Scalar *, const Scalar *, Scalar,    \
+                                   Scalar, const CandidateBlock<Scalar, Dim> &, \
+                                   Scalar *);
+
+INSTANTIATE_PREDICT_COLLISIONS(float, 2)
+INSTANTIATE_PREDICT_COLLISIONS(float, 3)
+INSTANTIATE_PREDICT_COLLISIONS(float, 4)
+INSTANTIATE_PREDICT_COLLISIONS(double, 2)
+INSTANTIATE_PREDICT_COLLISIONS(double, 3)
+INSTANTIATE_PREDICT_COLLISIONS(double, 4)
+INSTANTIATE_PREDICT_COLLISIONS(long double, 2)
+INSTANTIATE_PREDICT_COLLISIONS(long double, 3)
+INSTANTIATE_PREDICT_COLLISIONS(long double, 4)
@@ -0,0 +1,80 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "Ensemble.h"
+#include "parallel.h"
+
+template <typename Scalar, int Dim>
+BasicEnsemble<Scalar, Dim>::BasicEnsemble(int n, int replica_count,
+                                          std::uint64_t seed,
+                                          QueueType queue_type)
+    : n(n), replica_count(replica_count), seed(seed),
+      queue_type(queue_type) {}
+
+template <typename Scalar, int Dim>
+void BasicEnsemble<Scalar, Dim>::run() {
+  this->collision_times.assign(this->replica_count,
+                               std::vector<long double>());
+  this->stale_events.assign(this->replica_count, 0);
+
+  // replicas can take very different times, so threads take them one at a
+  // time instead of in fixed chunks
+  int threads = std::min(resolve_thread_count(this->thread_count),
+                         std::max(1, this->replica_count));
+  std::atomic<int> next_replica(0);
+  parallel_for(threads, threads, [&](int, int, int) {
+    BasicEventDrivenSimulation<Scalar, Dim> simulation(this->queue_type);
+    simulation.set_thread_count(1);
+    simulation.set_sector_count(1);
+
+    int r;
+    while ((r = next_replica.fetch_add(1, std::memory_order_relaxed)) <
+           this->replica_count) {
+      simulation.reset(this->n, get_replica_seed(this->seed, r));
+      simulation.initialize_events();
+      simulation.run_simulation();
+
+      this->collision_times[r] = simulation.get_collision_times();
+      this->stale_events[r] = simulation.get_stale_event_count();
+    }
+  });
+}
+
+template <typename Scalar, int Dim>
+std::vector<long double>
+BasicEnsemble<Scalar, Dim>::get_merged_collision_times() const {
+  size_t total = 0;
+  for (const std::vector<long double> &times : this->collision_times) {
+    total += times.size();
+  }
+
+  std::vector<long double> merged;
+  merged.reserve(total);
+  for (const std::vector<long double> &times : this->collision_times) {
+    merged.insert(merged.end(), times.begin(), times.end());
+  }
+  std::sort(merged.begin(), merged.end());
+  return merged;
+}
+
+template <typename Scalar, int Dim>
+std::uint64_t BasicEnsemble<Scalar, Dim>::get_replica_seed(std::uint64_t seed,
+                                                           int r) {
+  // splitmix64 of the r-th step from seed
+  std::uint64_t z = seed + (std::uint64_t)(r + 1) * 0x9e3779b97f4a7c15ULL;
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+template class BasicEnsemble<float, 2>;
+template class BasicEnsemble<float, 3>;
+template class BasicEnsemble<float, 4>;
+template class BasicEnsemble<double, 2>;
+template class BasicEnsemble<double, 3>;
+template class BasicEnsemble<double, 4>;
+template class BasicEnsemble<long double, 2>;
+template class BasicEnsemble<long double, 3>;
+template class BasicEnsemble<long double, 4>;
@@ -1,111 +1,1001 @@
+#include <algorithm>
+#include <atomic>
 #include <cmath>
-#include <queue>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <mutex>
 #include <random>
+#include <thread>
 #include <vector>
 
 #include "EventDrivenSimulation.h"
+#include "MultiQueue.h"
+#include "PartitionedEventHeap.h"
+#include "Philox.h"
 #include "SpatialGrid.h"
+#include "Trace.h"
 #include "config.h"
+#include "parallel.h"
 
-EventDrivenSimulation::EventDrivenSimulation(int n)
-    : current_time(0.0), collision_times{}, event_queue{} {
+template <typename Scalar, int Dim>
+BasicEventDrivenSimulation<Scalar, Dim>::BasicEventDrivenSimulation(
+    int n, QueueType queue_type)
+    : BasicEventDrivenSimulation(queue_type) {
   std::random_device rd;
-  std::mt19937 gen(rd());
+  reset(n, rd());
+}
+
+template <typename Scalar, int Dim>
+BasicEventDrivenSimulation<Scalar, Dim>::BasicEventDrivenSimulation(
+    QueueType queue_type)
+    : sphere_count(0) {
+  this->event_queue = make_event_queue(queue_type, 0);
+  this->serial.queue = this->event_queue.get();
+}
+
+template <typename Scalar, int Dim>
+void BasicEventDrivenSimulation<Scalar, Dim>::reset(int n, std::uint64_t seed) {
+  // the spheres themselves take the streams from 0 up
+  PhiloxStream gen(seed, std::numeric_limits<std::uint64_t>::max());
   std::poisson_distribution<int> poisson_dist(n);
 
   // Generate a random number from the Poisson distribution
   this->sphere_count = poisson_dist(gen);
   // epsilon is defined as length^d / n^(1 / d-1)
-  double epsilon =
-      pow(TORUS_SIZE, DIMENSIONS) / pow(n, 1.0 / (double)(DIMENSIONS - 1));
-  double radius = epsilon * 0.5;
+  Scalar epsilon =
+      pow(TORUS_SIZE, Dim) / pow(n, 1.0 / (double)(Dim - 1));
+  Scalar radius = epsilon * 0.5;
 
   int num_cells = floor(TORUS_SIZE / epsilon);
-  long double cell_size = TORUS_SIZE / (long double)num_cells;
-
-  // dt * v < epsilon -> dt < epsilon / v
-  double velocity_magnitude = 1.0;
-  this->max_dt = epsilon / velocity_magnitude;
-  
+  Scalar cell_size = TORUS_SIZE / (Scalar)num_cells;
 
-  this->grid = SpatialGrid(cell_size, num_cells, this->sphere_count, radius);
+  this->grid.reset(cell_size, num_cells, this->sphere_count, radius, seed,
+                   this->thread_count);
+  // nothing is pending until initialize_events
+  this->event_queue->assign(std::vector<Event>(this->sphere_count));
+  this->next_collision.assign(this->sphere_count, Event());
+  this->events_since_reorder = 0;
+  this->serial.current_time = 0;
+  this->serial.events = 0;
+  this->serial.stale_events = 0;
+  this->serial.rolled_back = 0;
+  this->serial.stats = SimulationStats();
+  this->serial.collision_times.clear();
 }
 
-void EventDrivenSimulation::run_simulation() {
-  // event_queue nolonger contains every possible event
-  // while (!this->event_queue.empty() && this->current_time < MAX_SIMULATION_TIME) {
-  //   this->run_simulation_step();
-  // } 
+template <typename Scalar, int Dim>
+BasicEventDrivenSimulation<Scalar, Dim>::BasicEventDrivenSimulation(
+    int n, BasicSphere<Dim> *spheres, QueueType queue_type)
+    : sphere_count(n) {
+  // cells have to be at least one diameter wide
+  Scalar epsilon = 2.0 * spheres[0].get_radius();
+  int num_cells = std::max(1, (int)floor(TORUS_SIZE / epsilon));
+  Scalar cell_size = TORUS_SIZE / (Scalar)num_cells;
+
+  this->grid = BasicSpatialGrid<Scalar, Dim>(cell_size, num_cells, this->sphere_count, spheres);
+  this->event_queue = make_event_queue(queue_type, this->sphere_count);
+  this->serial.queue = this->event_queue.get();
+  this->next_collision.assign(this->sphere_count, Event());
+}
 
-  while (this->current_time < MAX_SIMULATION_TIME) {
-    // if there are no more events within the maximum time step
-    // we need to step forward by the maximum time step
-    // and check for new events
-    if (!this->event_queue.empty()) {
-      this->run_simulation_step();
+template <typename Scalar, int Dim>
+void BasicEventDrivenSimulation<Scalar, Dim>::run_simulation() {
+  TRACE_PHASE("run_simulation");
+  // small grids may not have room for more than one sector
+  int sectors = resolve_thread_count(this->sector_count);
+  if (sectors > 1 && this->grid.set_sector_count(sectors) > 1) {
+    if (this->sector_scheduling == SectorScheduling::MULTI_QUEUE) {
+      this->run_multi_queue();
     } else {
-      this->grid.update_positions(this->max_dt);
-      this->current_time += this->max_dt;
-      this->initialize_events();
+      this->run_sectors();
     }
+    this->grid.set_sector_count(1);
+  }
+
+  // every moving sphere always has a pending cell transfer, so the grid stays
+  // consistent and the queue only drains once no sphere can collide anymore
+  while (!this->event_queue->empty() &&
+         this->event_queue->top().time < MAX_SIMULATION_TIME) {
+    this->run_simulation_step();
+  }
+
+  this->serial.current_time = MAX_SIMULATION_TIME;
+  this->grid.synchronize(this->serial.current_time);
+
+  if (this->stats_output != nullptr) {
+    this->get_stats().write_json(*this->stats_output);
   }
 }
 
-void EventDrivenSimulation::run_simulation_step() {
-  Event event = this->event_queue.top();
-  this->event_queue.pop();
+template <typename Scalar, int Dim>
+void BasicEventDrivenSimulation<Scalar, Dim>::run_simulation_step() {
+  TRACE_SCOPE("event");
+  // the event stays in its sphere's slot until handle_event replaces it
+  Event event = this->top_event(*this->event_queue);
 
-  this->current_time = event.time;
-  this->handle_event(event);
+  this->serial.current_time = event.time;
+  this->handle_event(this->serial, event);
+
+  if (this->reorder_interval > 0 &&
+      ++this->events_since_reorder >= this->reorder_interval) {
+    this->reorder_spheres();
+  }
 }
 
-void EventDrivenSimulation::handle_event(Event &event) {
-  this->grid.update_positions(event.time - this->current_time);
+template <typename Scalar, int Dim>
+void BasicEventDrivenSimulation<Scalar, Dim>::handle_event(Worker &worker,
+                                                           Event &event) {
+  TRACE_SCOPE("handle_event");
+  worker.events++;
+  if (event.is_transfer()) {
+    this->handle_transfer(worker, event);
+    return;
+  }
 
-  Sphere *s1 = event.s1;
-  Sphere *s2 = event.s2;
+  BasicSphereStore<Scalar, Dim> &spheres = this->grid.get_spheres();
+  int s1 = event.s1;
+  int s2 = event.s2;
 
-  // TODO: handle edge case where spheres collide at boundary
-  // discard event if spheres are no longer colliding
-  // maybe offload this to the spatial grid
-  double collision_time = collide(s1, s2);
-  if (collision_time < 0) {
+  // discard event if either sphere has collided since it was predicted and
+  // look for the next collision of the sphere it belonged to
+  if (this->is_stale(event)) {
+    worker.stale_events++;
+    this->grid.advance_sphere(s1, worker.current_time);
+    this->find_collision_events(worker, s1);
     return;
   }
 
-  resolve_collision(s1, s2);
+  // only the spheres taking part in the event are moved to the event time.
+  // they may touch across the boundary of the torus, which
+  // resolve_collision accounts for
+  this->grid.advance_sphere(s1, worker.current_time);
+  this->grid.advance_sphere(s2, worker.current_time);
+  {
+    TRACE_SCOPE("resolve_collision");
+    resolve_collision(spheres, s1, s2);
+  }
+
+  spheres.decrement_collision_checks(s1);
+  spheres.decrement_collision_checks(s2);
+
+  worker.collision_times.push_back(worker.current_time);
+
+  // replace the next event of both spheres
+  this->find_collision_events(worker, s1);
+  this->find_collision_events(worker, s2);
+}
+
+template <typename Scalar, int Dim>
+void BasicEventDrivenSimulation<Scalar, Dim>::handle_transfer(Worker &worker,
+                                                              Event &event) {
+  int s = event.s1;
+
+  this->grid.advance_sphere(s, worker.current_time);
+
+  // the collision found before the transfer is only kept if it is still
+  // valid. otherwise the whole new neighbourhood has to be searched again.
+  COUNT_STAT(worker.stats.cell_migrations++);
+  if (this->is_stale(this->next_collision[s])) {
+    this->grid.transfer_sphere(s, [](int) {}, &worker.stats);
+    this->find_collision_events(worker, s);
+    return;
+  }
+
+  // only the spheres in the cells that just became adjacent are new
+  worker.candidates.clear();
+  this->grid.transfer_sphere(
+      s,
+      [&](int other) {
+        COUNT_STAT(worker.stats.candidate_pairs++);
+        this->grid.pack_candidate(s, other, worker.candidates);
+      },
+      &worker.stats);
+  this->predict_candidates(worker, s, this->next_collision[s]);
+
+  this->schedule(worker, s);
+}
+
+template <typename Scalar, int Dim>
+void BasicEventDrivenSimulation<Scalar, Dim>::initialize_events() {
+  TRACE_PHASE("initialize_events");
+  // spheres are generated in random order, so start out sorted
+  if (this->reorder_interval > 0) {
+    this->reorder_spheres();
+  }
+
+  const BasicSphereStore<Scalar, Dim> &spheres = this->grid.get_spheres();
+  int threads = std::min(resolve_thread_count(this->thread_count),
+                         std::max(1, this->sphere_count));
+
+  // every neighbouring pair is predicted once, from the sphere it comes
+  // first for. each thread collects the collisions of its own range of
+  // spheres with its own candidate buffers
+  std::vector<std::vector<Event>> found(threads);
+  std::vector<SimulationStats> stats(threads);
+  parallel_for(this->sphere_count, threads, [&](int thread, int begin,
+                                                int end) {
+    TRACE_PHASE("initial_predictions");
+    CandidateBlock<Scalar, Dim> block;
+    std::vector<Scalar> times;
+
+    for (int s = begin; s < end; s++) {
+      if (spheres.collision_checks(s) <= 0) {
+        continue;
+      }
+
+      block.clear();
+      this->grid.for_each_forward_sphere(
+          s,
+          [&](int other) {
+            COUNT_STAT(stats[thread].candidate_pairs++);
+            this->grid.pack_candidate(s, other, block);
+          },
+          &stats[thread]);
+      this->predict_times(s, block, times);
+      COUNT_STAT(stats[thread].collide_calls += block.size());
+
+      for (int k = 0; k < block.size(); k++) {
+        if (times[k] >= 0) {
+          int other = block.index[k];
+          Scalar time = this->serial.current_time + times[k];
+          found[thread].push_back(Event(time, s, other,
+                                        spheres.collision_count(s),
+                                        spheres.collision_count(other)));
+        }
+      }
+    }
+  });
+
+  // each collision is offered to both spheres. the threads hold consecutive
+  // ranges, so merging them in order sees the pairs in the same order a
+  // single thread would
+  this->next_collision.assign(this->sphere_count, Event());
+  for (const std::vector<Event> &events : found) {
+    for (const Event &event : events) {
+      if (event.time < this->next_collision[event.s1].time) {
+        this->next_collision[event.s1] = event;
+      }
+      if (event.time < this->next_collision[event.s2].time) {
+        this->next_collision[event.s2] =
+            Event(event.time, event.s2, event.s1, event.s2_collisions,
+                  event.s1_collisions);
+      }
+    }
+  }
+
+  // and the queue is built in one go
+  std::vector<Event> events(this->sphere_count);
+  parallel_for(this->sphere_count, threads, [&](int, int begin, int end) {
+    for (int s = begin; s < end; s++) {
+      events[s] = this->next_event(s, this->serial.current_time);
+    }
+  });
+  this->event_queue->assign(events);
+
+  for (const SimulationStats &thread_stats : stats) {
+    this->serial.stats.merge(thread_stats);
+  }
+  COUNT_STAT(this->serial.stats.set_pending(
+      std::count_if(events.begin(), events.end(),
+                    [](const Event &event) { return event.s1 >= 0; })));
+}
+
+template <typename Scalar, int Dim>
+void BasicEventDrivenSimulation<Scalar, Dim>::find_collision_events(
+    Worker &worker, int s) {
+  // only the earliest collision of s is kept
+  Event next_event;
+
+  // s is at the current time. the other spheres are left at their own local
+  // time and projected forward when they are packed
+  this->grid.get_nearby_candidates(s, worker.candidates, &worker.stats);
+  this->predict_candidates(worker, s, next_event);
+
+  this->next_collision[s] = next_event;
+  this->schedule(worker, s);
+}
+
+template <typename Scalar, int Dim>
+void BasicEventDrivenSimulation<Scalar, Dim>::predict_times(
+    int s, const CandidateBlock<Scalar, Dim> &block,
+    std::vector<Scalar> &times) const {
+  TRACE_SCOPE("collide");
+  const BasicSphereStore<Scalar, Dim> &spheres = this->grid.get_spheres();
+
+  Scalar center[Dim];
+  Scalar velocity[Dim];
+  for (int i = 0; i < Dim; i++) {
+    center[i] = spheres.center(s, i);
+    velocity[i] = spheres.velocity(s, i);
+  }
+
+  times.resize(block.size());
+  predict_collisions(center, velocity, spheres.radius(s),
+                     spheres.get_torus_size(), block, times.data());
+}
+
+template <typename Scalar, int Dim>
+void BasicEventDrivenSimulation<Scalar, Dim>::predict_candidates(
+    Worker &worker, int s, Event &next_event) {
+  const BasicSphereStore<Scalar, Dim> &spheres = this->grid.get_spheres();
+
+  // collide would reject every candidate
+  if (spheres.collision_checks(s) <= 0) {
+    return;
+  }
+
+  this->predict_times(s, worker.candidates, worker.candidate_times);
+  COUNT_STAT(worker.stats.collide_calls += worker.candidates.size());
+
+  for (int k = 0; k < worker.candidates.size(); k++) {
+    Scalar collision_time = worker.candidate_times[k];
+    // discard event if spheres do not collide
+    if (collision_time >= 0 &&
+        worker.current_time + collision_time < next_event.time) {
+      int other = worker.candidates.index[k];
+      next_event =
+          Event(worker.current_time + collision_time, s, other,
+                spheres.collision_count(s), spheres.collision_count(other));
+    }
+  }
+}
+
+template <typename Scalar, int Dim>
+Event BasicEventDrivenSimulation<Scalar, Dim>::next_event(int s, Scalar now) {
+  const BasicSphereStore<Scalar, Dim> &spheres = this->grid.get_spheres();
+
+  // spheres that can no longer collide are not tracked any further
+  if (spheres.collision_checks(s) <= 0) {
+    return Event();
+  }
+
+  // the next event of a sphere is its next collision or, if it leaves its
+  // cell before that, the transfer into the neighbouring cell
+  Event transfer(now + this->grid.time_to_transfer(s), s,
+                 spheres.collision_count(s));
+  if (this->next_collision[s].time <= transfer.time) {
+    return this->next_collision[s];
+  }
+  return transfer;
+}
+
+template <typename Scalar, int Dim>
+void BasicEventDrivenSimulation<Scalar, Dim>::schedule(Worker &worker, int s) {
+  TRACE_SCOPE("queue_update");
+  Event event = this->next_event(s, worker.current_time);
+  COUNT_STAT(worker.stats.replace_pending(worker.queue->get(s).s1 >= 0,
+                                          event.s1 >= 0));
+  worker.queue->update(s, event);
+}
+
+template <typename Scalar, int Dim>
+void BasicEventDrivenSimulation<Scalar, Dim>::run_sectors() {
+  int sectors = this->grid.get_sector_count();
+
+  // the pending event of every sphere goes to the sector it is in
+  std::vector<Event> events(this->sphere_count);
+  std::vector<int> owner(this->sphere_count);
+  for (int i = 0; i < this->sphere_count; i++) {
+    events[i] = this->event_queue->get(i);
+    owner[i] = this->grid.get_sector(i);
+  }
+  PartitionedEventHeap queue(this->sphere_count, sectors);
+  queue.assign(events, owner);
+  this->serial.queue = &queue;
+
+  std::vector<Worker> workers(sectors);
+  for (int p = 0; p < sectors; p++) {
+    workers[p].queue = &queue.partition(p);
+  }
+  // the collision log is in order up to here
+  size_t sorted = this->serial.collision_times.size();
+
+  if (this->sector_scheduling == SectorScheduling::TIME_WARP) {
+    this->run_time_warp(queue, workers);
+  } else {
+    this->run_windows(queue, workers);
+  }
+
+  // every sector logged its own collisions in order, so together they only
+  // need sorting into the order of the serial run
+  for (Worker &worker : workers) {
+    this->commit(worker, std::numeric_limits<long double>::infinity());
+    this->serial.collision_times.insert(this->serial.collision_times.end(),
+                                        worker.collision_times.begin(),
+                                        worker.collision_times.end());
+    this->serial.events += worker.events;
+    this->serial.stale_events += worker.stale_events;
+    this->serial.rolled_back += worker.rolled_back;
+    this->serial.stats.merge(worker.stats);
+  }
+  std::sort(this->serial.collision_times.begin() + sorted,
+            this->serial.collision_times.end());
+
+  for (int i = 0; i < this->sphere_count; i++) {
+    events[i] = queue.get(i);
+  }
+  this->event_queue->assign(events);
+  this->serial.queue = this->event_queue.get();
+}
+
+template <typename Scalar, int Dim>
+void BasicEventDrivenSimulation<Scalar, Dim>::run_windows(
+    PartitionedEventHeap &queue, std::vector<Worker> &workers) {
+  int sectors = (int)workers.size();
+  // how far every sector has got in the current round, rounded down, so no
+  // sector runs past where another one is. it follows the sector event by
+  // event
+  std::vector<std::atomic<double>> reached(sectors);
+  std::vector<std::atomic<bool>> stopped(sectors);
+
+  auto running = [&]() {
+    return !queue.empty() && queue.top().time < MAX_SIMULATION_TIME;
+  };
+
+  // every sector keeps its thread for the whole run. thread 0 handles what
+  // reaches across sector borders while the others wait at the barrier
+  Barrier barrier(sectors);
+  bool finished = false;
+  parallel_for(sectors, sectors, [&](int p, int, int) {
+    int before = (p + sectors - 1) % sectors;
+    int after = (p + 1) % sectors;
+
+    while (true) {
+      if (p == 0) {
+        TRACE_PHASE("border_events");
+        finished = !running();
+        // events that reach across a sector border are handled one at a
+        // time, and so is the earliest event, whatever it is, so every round
+        // gets on. the sectors around one may have run past it, so they are
+        // taken back to it first
+        while (!finished) {
+          TRACE_SCOPE("event");
+          Event event = this->top_event(queue);
+          if (!this->is_local(event, queue)) {
+            int partner =
+                event.is_transfer() ? this->next_collision[event.s1].s2 : -1;
+            for (int s : {event.s1, event.s2, partner}) {
+              if (s >= 0) {
+                this->grid.for_each_sector_near(s, 2, [&](int q) {
+                  this->roll_back(workers, queue, q, event.time, [](int) {});
+                });
+              }
+            }
+          }
+
+          this->serial.current_time = event.time;
+          this->handle_event(this->serial, event);
+          if (event.is_transfer()) {
+            queue.move(event.s1, this->grid.get_sector(event.s1));
+          }
+          if (!running() || this->is_local(queue.top(), queue)) {
+            break;
+          }
+        }
+
+        // nothing before the earliest pending event, the global virtual
+        // time, can be taken back anymore
+        long double committed = queue.top().time;
+        for (Worker &worker : workers) {
+          this->commit(worker, committed);
+        }
+
+        for (int q = 0; q < sectors; q++) {
+          reached[q].store(time_floor(queue.partition(q).top().time));
+          stopped[q].store(false);
+        }
+      }
+      barrier.arrive_and_wait();
+      if (finished) {
+        break;
+      }
+
+      // hard spheres give no lookahead, so every sector runs ahead on its
+      // own events until it meets one that is not local. it also waits for
+      // its neighbours, the only sectors whose border events can take it
+      // back directly, to get past every event first, and stops once one of
+      // them has stopped before it
+      {
+        TRACE_PHASE("run_ahead");
+        long double stop =
+            this->run_ahead(workers[p], queue, [&](const Event &event) {
+              double time = time_floor(event.time);
+              reached[p].store(time);
+              while (true) {
+                bool wait = false;
+                for (int q : {before, after}) {
+                  bool done = stopped[q].load();
+                  double other = reached[q].load();
+                  if (event.time < other) {
+                    continue;
+                  }
+                  // of two sectors at the same time the first one gives way,
+                  // so they do not wait for each other
+                  if (done || (other == time && p < q)) {
+                    return true;
+                  }
+                  wait = true;
+                }
+                if (!wait) {
+                  return false;
+                }
+                std::this_thread::yield();
+              }
+            });
+        reached[p].store(time_floor(stop));
+        stopped[p].store(true);
+      }
+      barrier.arrive_and_wait();
+    }
+  });
+}
+
+template <typename Scalar, int Dim>
+void BasicEventDrivenSimulation<Scalar, Dim>::run_time_warp(
+    PartitionedEventHeap &queue, std::vector<Worker> &workers) {
+  int sectors = (int)workers.size();
+  TimeWarp warp(queue, workers);
+  for (int p = 0; p < sectors; p++) {
+    warp.progress[p].store(time_floor(queue.partition(p).top().time));
+  }
+
+  // there are no rounds. every sector handles its own events as they come,
+  // border events included, and is taken back whenever a border event of
+  // another sector reaches it in its past
+  parallel_for(sectors, sectors, [&](int p, int, int) {
+    TRACE_PHASE("time_warp");
+    Worker &worker = workers[p];
+    int before = (p + sectors - 1) % sectors;
+    int after = (p + 1) % sectors;
+    long handled = 0;
+
+    while (true) {
+      Event event;
+      bool local = false;
+      {
+        TRACE_SCOPE("event");
+        std::lock_guard<std::mutex> lock(warp.locks[p]);
+        event = this->top_event(*worker.queue);
+        local = event.time < MAX_SIMULATION_TIME &&
+                this->is_local(event, queue);
+        if (local) {
+          worker.undo.push_back(this->save_undo(worker, event, queue));
+          worker.current_time = event.time;
+          this->handle_event(worker, event);
+          warp.progress[p].store(time_floor(worker.queue->top().time));
+        }
+      }
+
+      if (local) {
+        // now and then the records nothing can take back anymore are dropped
+        if (++handled % COMMIT_INTERVAL == 0) {
+          double gvt = warp.update_gvt(false);
+          std::lock_guard<std::mutex> lock(warp.locks[p]);
+          this->commit(worker, gvt);
+        }
+        continue;
+      }
+
+      if (event.time >= MAX_SIMULATION_TIME) {
+        // done, unless a border event hands it more or takes it back
+        if (warp.update_gvt(true) >= MAX_SIMULATION_TIME) {
+          break;
+        }
+        std::this_thread::yield();
+        continue;
+      }
+
+      // a border event has to wait for the neighbours to get to it
+      double time = time_floor(event.time);
+      if (warp.progress[before].load() < time ||
+          warp.progress[after].load() < time ||
+          !this->handle_border(warp, p)) {
+        std::this_thread::yield();
+      }
+    }
+  });
+}
+
+template <typename Scalar, int Dim>
+bool BasicEventDrivenSimulation<Scalar, Dim>::handle_border(TimeWarp &warp,
+                                                            int p) {
+  TRACE_SCOPE("border_event");
+  PartitionedEventHeap &queue = warp.queue;
+  std::lock_guard<std::mutex> border(warp.border);
+
+  // sectors are locked as they are met. no other thread holds more than
+  // one, so the order does not matter
+  std::vector<int> held;
+  auto hold = [&](int q) {
+    if (std::find(held.begin(), held.end(), q) == held.end()) {
+      warp.locks[q].lock();
+      held.push_back(q);
+    }
+  };
+  auto release = [&]() {
+    for (int q : held) {
+      warp.progress[q].store(time_floor(queue.partition(q).top().time));
+      warp.locks[q].unlock();
+    }
+  };
+
+  hold(p);
+  Event event = this->top_event(queue.partition(p));
+  if (event.time >= MAX_SIMULATION_TIME || this->is_local(event, queue)) {
+    release();
+    return true;
+  }
 
-  s1->decrement_collision_checks();
-  s2->decrement_collision_checks();
+  // the event reads the cells up to two columns from its spheres, and a
+  // transfer the collision count of the sphere s was going to collide with
+  std::vector<int> touched = {p};
+  auto touch = [&](int q) {
+    if (std::find(touched.begin(), touched.end(), q) == touched.end()) {
+      touched.push_back(q);
+    }
+  };
+  for (int s : {event.s1, event.s2}) {
+    if (s >= 0) {
+      this->grid.for_each_sector_near(s, 2, touch);
+    }
+  }
+  int partner = event.is_transfer() ? this->next_collision[event.s1].s2 : -1;
+  if (partner >= 0) {
+    touch(queue.get_partition(partner));
+  }
 
-  if (s1->get_max_collision_checks() > 0) {
-    this->find_collision_events(s1);
+  // those that ran past it are taken back, together with whatever depended
+  // on what they did. what they handled at the same time stays
+  long double after =
+      std::nextafter(event.time, std::numeric_limits<long double>::infinity());
+  for (int q : touched) {
+    hold(q);
+    this->roll_back(warp.workers, queue, q, after, hold);
   }
 
-  if (s2->get_max_collision_checks() > 0) {
-    this->find_collision_events(s2);
+  // and every one of them has to have got to it
+  const Event &top = queue.partition(p).top();
+  bool ready = top.s1 == event.s1 && top.time == event.time;
+  for (int q : touched) {
+    ready = ready && queue.partition(q).top().time >= event.time;
+  }
+  if (!ready) {
+    release();
+    return false;
   }
+
+  // the other sectors only point back at the record, so taking back any of
+  // them takes back the event
+  Worker &worker = warp.workers[p];
+  Undo record = this->save_undo(worker, event, queue);
+  Undo link;
+  link.time = event.time;
+  link.owner = p;
+  for (int q : touched) {
+    if (q != p) {
+      record.linked.push_back(q);
+      warp.workers[q].undo.push_back(link);
+    }
+  }
+  worker.undo.push_back(record);
+
+  worker.current_time = event.time;
+  this->handle_event(worker, event);
+  if (event.is_transfer()) {
+    queue.move(event.s1, this->grid.get_sector(event.s1));
+  }
+
+  release();
+  return true;
 }
 
-void EventDrivenSimulation::initialize_events() {
-  Sphere *spheres = this->grid.get_spheres();
+template <typename Scalar, int Dim>
+void BasicEventDrivenSimulation<Scalar, Dim>::run_multi_queue() {
+  int sectors = this->grid.get_sector_count();
+
+  std::vector<Event> events(this->sphere_count);
+  std::vector<int> owner(this->sphere_count);
   for (int i = 0; i < this->sphere_count; i++) {
-    this->find_collision_events(&spheres[i]);
+    events[i] = this->event_queue->get(i);
+    owner[i] = this->grid.get_sector(i);
   }
+  MultiQueue queue(this->sphere_count, sectors);
+  queue.assign(events, owner);
+
+  auto earliest = [&]() {
+    int top = 0;
+    for (int p = 1; p < sectors; p++) {
+      if (queue.peek(p) < queue.peek(top)) {
+        top = p;
+      }
+    }
+    return top;
+  };
+
+  int threads = std::min(resolve_thread_count(this->thread_count), sectors);
+  std::vector<Worker> workers(threads);
+  parallel_for(threads, threads, [&](int thread, int, int) {
+    TRACE_PHASE("multi_queue");
+    Worker &worker = workers[thread];
+    worker.queue = &queue;
+    // only decides which sector is tried next, not what happens
+    std::mt19937 gen(thread);
+    std::vector<int> held;
+
+    // a sector is picked by two choices. after a run of misses the earliest
+    // one is tried, which can always go ahead once it gets its locks
+    int misses = 0;
+    while (true) {
+      int p = misses < sectors ? queue.choose(gen) : earliest();
+      if (queue.peek(p) >= MAX_SIMULATION_TIME) {
+        if (queue.peek(earliest()) >= MAX_SIMULATION_TIME) {
+          break;
+        }
+        misses = sectors;
+        continue;
+      }
+
+      if (this->try_handle(worker, queue, p, held)) {
+        misses = 0;
+      } else {
+        misses++;
+        std::this_thread::yield();
+      }
+    }
+  });
+
+  // every worker logged in its own order
+  size_t sorted = this->serial.collision_times.size();
+  for (Worker &worker : workers) {
+    this->serial.collision_times.insert(this->serial.collision_times.end(),
+                                        worker.collision_times.begin(),
+                                        worker.collision_times.end());
+    this->serial.events += worker.events;
+    this->serial.stale_events += worker.stale_events;
+    this->serial.stats.merge(worker.stats);
+  }
+  std::sort(this->serial.collision_times.begin() + sorted,
+            this->serial.collision_times.end());
+
+  for (int i = 0; i < this->sphere_count; i++) {
+    events[i] = queue.get(i);
+  }
+  this->event_queue->assign(events);
 }
 
-void EventDrivenSimulation::find_collision_events(Sphere *s) {
-  std::vector<Sphere *> nearby_spheres = this->grid.get_nearby_spheres(s);
-  for (auto &other : nearby_spheres) {
-    if (s == other) {
+template <typename Scalar, int Dim>
+bool BasicEventDrivenSimulation<Scalar, Dim>::try_handle(
+    Worker &worker, MultiQueue &queue, int p, std::vector<int> &held) {
+  auto lock = [&](int q) {
+    if (std::find(held.begin(), held.end(), q) != held.end()) {
+      return true;
+    }
+    if (!queue.try_lock(q)) {
+      return false;
+    }
+    held.push_back(q);
+    return true;
+  };
+  auto release = [&]() {
+    for (int q : held) {
+      queue.unlock(q);
+    }
+    held.clear();
+  };
+
+  TRACE_SCOPE("try_handle");
+  if (!lock(p)) {
+    return false;
+  }
+  Event event = this->top_event(queue.partition(p));
+
+  // besides s1, the event reads s2, or for a transfer the sphere s1 was
+  // going to collide with. once their sectors are locked they stay put
+  int partner = event.is_transfer() ? this->next_collision[event.s1].s2 : -1;
+  for (int s : {event.s1, event.s2, partner}) {
+    if (s < 0) {
       continue;
     }
+    int q = queue.get_partition(s);
+    if (!lock(q) || queue.get_partition(s) != q) {
+      release();
+      return false;
+    }
+  }
 
-    double collision_time = collide(s, other);
-    // discard event if spheres do not collide
-    if (collision_time >= 0) {
-      this->event_queue.push(
-          Event(this->current_time + collision_time, s, other));
+  // the event reads and moves spheres up to two columns from s1 and s2. an
+  // earlier event that changes any of that involves a sphere within two
+  // columns of those, and so does one that changes the collision count of
+  // the partner. if one of the sectors they are in has an earlier event, it
+  // has to go first
+  bool blocked = false;
+  auto reach = [&](int s, int margin) {
+    this->grid.for_each_sector_near(s, margin, [&](int q) {
+      if (!blocked && (!lock(q) || queue.partition(q).top().time < event.time)) {
+        blocked = true;
+      }
+    });
+  };
+  reach(event.s1, 4);
+  if (event.s2 >= 0) {
+    reach(event.s2, 4);
+  }
+  if (partner >= 0) {
+    reach(partner, 2);
+  }
+  if (blocked || event.time >= MAX_SIMULATION_TIME) {
+    release();
+    return false;
+  }
+
+  worker.current_time = event.time;
+  this->handle_event(worker, event);
+  if (event.is_transfer()) {
+    queue.move(event.s1, this->grid.get_sector(event.s1));
+  }
+
+  release();
+  return true;
+}
+
+template <typename Scalar, int Dim>
+template <typename Stop>
+long double BasicEventDrivenSimulation<Scalar, Dim>::run_ahead(
+    Worker &worker, const PartitionedEventHeap &queue, Stop &&stop) {
+  while (!worker.queue->empty()) {
+    TRACE_SCOPE("event");
+    Event event = this->top_event(*worker.queue);
+    if (event.time >= MAX_SIMULATION_TIME) {
+      break;
+    }
+    if (!this->is_local(event, queue) || stop(event)) {
+      return event.time;
+    }
+
+    worker.undo.push_back(this->save_undo(worker, event, queue));
+    worker.current_time = event.time;
+    this->handle_event(worker, event);
+  }
+  return std::numeric_limits<long double>::infinity();
+}
+
+template <typename Scalar, int Dim>
+typename BasicEventDrivenSimulation<Scalar, Dim>::Undo
+BasicEventDrivenSimulation<Scalar, Dim>::save_undo(
+    const Worker &worker, const Event &event,
+    const PartitionedEventHeap &queue) const {
+  Undo record;
+  record.time = event.time;
+  record.spheres[0] = event.s1;
+  record.spheres[1] = event.s2;
+  for (int k = 0; k < 2; k++) {
+    int s = record.spheres[k];
+    if (s >= 0) {
+      record.state[k] = this->grid.save_sphere(s);
+      record.next_collision[k] = this->next_collision[s];
+      record.pending[k] = queue.get(s);
+      record.partition[k] = queue.get_partition(s);
+    }
+  }
+  record.collision_count = worker.collision_times.size();
+  record.events = worker.events;
+  record.stale_events = worker.stale_events;
+  return record;
+}
+
+template <typename Scalar, int Dim>
+template <typename Hold>
+void BasicEventDrivenSimulation<Scalar, Dim>::roll_back(
+    std::vector<Worker> &workers, PartitionedEventHeap &queue, int p,
+    long double time, Hold &&hold) {
+  TRACE_SCOPE("roll_back");
+  Worker &worker = workers[p];
+  while (!worker.undo.empty() && worker.undo.back().time >= time) {
+    // the other sectors taken back below may drop records of their own
+    Undo record = worker.undo.back();
+    worker.undo.pop_back();
+
+    if (record.owner >= 0) {
+      hold(record.owner);
+      this->roll_back(workers, queue, record.owner, record.time, hold);
+      continue;
     }
+    // what the other sectors did since may have depended on the event
+    for (int q : record.linked) {
+      hold(q);
+      this->roll_back(workers, queue, q, record.time, hold);
+    }
+
+    for (int k = 1; k >= 0; k--) {
+      int s = record.spheres[k];
+      if (s >= 0) {
+        this->grid.restore_sphere(s, record.state[k]);
+        this->next_collision[s] = record.next_collision[k];
+        queue.move(s, record.partition[k]);
+        COUNT_STAT(worker.stats.replace_pending(queue.get(s).s1 >= 0,
+                                                record.pending[k].s1 >= 0));
+        queue.update(s, record.pending[k]);
+      }
+    }
+    worker.collision_times.resize(record.collision_count);
+    worker.events = record.events;
+    worker.stale_events = record.stale_events;
+    worker.rolled_back++;
+  }
+}
+
+template <typename Scalar, int Dim>
+void BasicEventDrivenSimulation<Scalar, Dim>::commit(Worker &worker,
+                                                     long double time) {
+  TRACE_SCOPE("commit");
+  // the records are in time order, so the ones before time come first
+  auto end = std::lower_bound(
+      worker.undo.begin(), worker.undo.end(), time,
+      [](const Undo &record, long double t) { return record.time < t; });
+  worker.undo.erase(worker.undo.begin(), end);
+}
+
+template <typename Scalar, int Dim>
+bool BasicEventDrivenSimulation<Scalar, Dim>::is_local(
+    const Event &event, const PartitionedEventHeap &queue) const {
+  // the sector a sphere is queued in can be read for spheres of other
+  // sectors, it does not change while the sector handles its own events.
+  // their cells can not
+  int s = event.s1;
+  int p = queue.get_partition(s);
+
+  // a transfer moves s by one cell and reads the cells next to the new one.
+  // it also checks whether the collision s had found is still on
+  if (event.is_transfer()) {
+    int other = this->next_collision[s].s2;
+    return (other < 0 || queue.get_partition(other) == p) &&
+           this->grid.in_sector_interior(s, 1);
   }
-}
\ No newline at end of file
+
+  return queue.get_partition(event.s2) == p &&
+         this->grid.in_sector_interior(s) &&
+         this->grid.in_sector_interior(event.s2);
+}
+
+template <typename Scalar, int Dim>
+void BasicEventDrivenSimulation<Scalar, Dim>::reorder_spheres() {
+  std::vector<int> order = this->grid.reorder();
+  std::vector<int> new_index(this->sphere_count);
+  for (int i = 0; i < this->sphere_count; i++) {
+    new_index[order[i]] = i;
+  }
+
+  auto renumber = [&](Event event) {
+    if (event.s1 >= 0) {
+      event.s1 = new_index[event.s1];
+    }
+    if (event.s2 >= 0) {
+      event.s2 = new_index[event.s2];
+    }
+    return event;
+  };
+
+  // the queue keeps one slot per sphere index, so it is rebuilt in the new
+  // order rather than updated slot by slot
+  std::vector<Event> next_collision(this->sphere_count);
+  std::vector<Event> events(this->sphere_count);
+  for (int i = 0; i < this->sphere_count; i++) {
+    next_collision[i] = renumber(this->next_collision[order[i]]);
+    events[i] = renumber(this->event_queue->get(order[i]));
+  }
+  this->next_collision.swap(next_collision);
+  this->event_queue->assign(events);
+
+  this->events_since_reorder = 0;
+}
+
+template class BasicEventDrivenSimulation<float, 2>;
+template class BasicEventDrivenSimulation<float, 3>;
+template class BasicEventDrivenSimulation<float, 4>;
+template class BasicEventDrivenSimulation<double, 2>;
+template class BasicEventDrivenSimulation<double, 3>;
+template class BasicEventDrivenSimulation<double, 4>;
+template class BasicEventDrivenSimulation<long double, 2>;
+template class BasicEventDrivenSimulation<long double, 3>;
+template class BasicEventDrivenSimulation<long double, 4>;
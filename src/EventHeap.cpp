@@ -0,0 +1,36 @@
+#include <cmath>
+#include <vector>
+
+#include "EventHeap.h"
+
+EventHeap::EventHeap(int size)
+    : events(size), heap(size), position(size) {
+  // every slot starts out empty, so any order is a valid heap
+  for (int i = 0; i < size; i++) {
+    this->heap[i] = i;
+    this->position[i] = i;
+  }
+}
+
+void EventHeap::update(int i, const Event &event) {
+  long double old_time = this->events[i].time;
+  this->events[i] = event;
+
+  heap_update(this->events, this->heap, this->position, i, old_time);
+}
+
+void EventHeap::assign(const std::vector<Event> &events) {
+  this->events = events;
+  int n = (int)events.size();
+  this->heap.resize(n);
+  this->position.resize(n);
+  for (int i = 0; i < n; i++) {
+    this->heap[i] = i;
+    this->position[i] = i;
+  }
+  heap_build(this->events, this->heap, this->position);
+}
+
+bool EventHeap::empty() const {
+  return this->heap.empty() || std::isinf(top().time);
+}
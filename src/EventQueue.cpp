@@ -0,0 +1,25 @@
+#include <memory>
+#include <vector>
+
+#include "CalendarQueue.h"
+#include "EventHeap.h"
+#include "EventQueue.h"
+#include "MultiQueue.h"
+
+void EventQueue::assign(const std::vector<Event> &events) {
+  for (int i = 0; i < (int)events.size(); i++) {
+    update(i, events[i]);
+  }
+}
+
+std::unique_ptr<EventQueue> make_event_queue(QueueType type, int size) {
+  switch (type) {
+  case QueueType::CALENDAR:
+    return std::make_unique<CalendarQueue>(size);
+  case QueueType::MULTI:
+    return std::make_unique<MultiQueue>(size);
+  case QueueType::HEAP:
+  default:
+    return std::make_unique<EventHeap>(size);
+  }
+}
@@ -0,0 +1,55 @@
+#include <random>
+#include <vector>
+
+#include "MultiQueue.h"
+
+MultiQueue::MultiQueue(int size, int partition_count)
+    : PartitionedEventHeap(size, partition_count),
+      locks(new std::mutex[partition_count]),
+      tops(new std::atomic<double>[partition_count]) {
+  std::vector<int> owner(size);
+  for (int i = 0; i < size; i++) {
+    owner[i] = i % partition_count;
+  }
+  assign(std::vector<Event>(size), owner);
+}
+
+void MultiQueue::update(int i, const Event &event) {
+  PartitionedEventHeap::update(i, event);
+  publish(get_partition(i));
+}
+
+void MultiQueue::assign(const std::vector<Event> &events,
+                        const std::vector<int> &owner) {
+  PartitionedEventHeap::assign(events, owner);
+  for (int p = 0; p < get_partition_count(); p++) {
+    publish(p);
+  }
+}
+
+void MultiQueue::move(int i, int p) {
+  int from = get_partition(i);
+  PartitionedEventHeap::move(i, p);
+  publish(from);
+  publish(p);
+}
+
+int MultiQueue::choose(std::mt19937 &gen) const {
+  int count = get_partition_count();
+  if (count == 1) {
+    return 0;
+  }
+
+  std::uniform_int_distribution<int> pick(0, count - 1);
+  int a = pick(gen);
+  int b = pick(gen);
+  while (b == a) {
+    b = pick(gen);
+  }
+  return peek(b) < peek(a) ? b : a;
+}
+
+void MultiQueue::publish(int p) {
+  // rounded down, so a partition never looks later than it is
+  this->tops[p].store(time_floor(partition(p).top().time));
+}
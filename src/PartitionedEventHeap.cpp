@@ -0,0 +1,127 @@
+#include <cmath>
+#include <vector>
+
+#include "PartitionedEventHeap.h"
+
+namespace {
+// what top returns for a queue without slots
+const Event no_event;
+} // namespace
+
+PartitionedEventHeap::PartitionedEventHeap(int size, int partition_count)
+    : events(size), owner(size), position(size), heaps(partition_count) {
+  // every slot starts out empty, so any order is a valid heap
+  for (int i = 0; i < size; i++) {
+    this->owner[i].store(0, std::memory_order_relaxed);
+    this->heaps[0].push_back(i);
+    this->position[i] = i;
+  }
+  for (int p = 0; p < partition_count; p++) {
+    this->partitions.emplace_back(this, p);
+  }
+}
+
+void PartitionedEventHeap::update(int i, const Event &event) {
+  long double old_time = this->events[i].time;
+  this->events[i] = event;
+
+  heap_update(this->events, this->heaps[get_partition(i)], this->position, i,
+              old_time);
+}
+
+void PartitionedEventHeap::assign(const std::vector<Event> &events) {
+  std::vector<int> owner(events.size());
+  for (int i = 0; i < (int)owner.size(); i++) {
+    owner[i] = i < (int)this->owner.size() ? get_partition(i)
+                                           : i % get_partition_count();
+  }
+  assign(events, owner);
+}
+
+void PartitionedEventHeap::assign(const std::vector<Event> &events,
+                                  const std::vector<int> &owner) {
+  this->events = events;
+  std::vector<std::atomic<int>> owners(owner.size());
+  for (int i = 0; i < (int)owner.size(); i++) {
+    owners[i].store(owner[i], std::memory_order_relaxed);
+  }
+  this->owner.swap(owners);
+  this->position.resize(events.size());
+  for (std::vector<int> &heap : this->heaps) {
+    heap.clear();
+  }
+  for (int i = 0; i < (int)events.size(); i++) {
+    std::vector<int> &heap = this->heaps[owner[i]];
+    this->position[i] = (int)heap.size();
+    heap.push_back(i);
+  }
+
+  for (std::vector<int> &heap : this->heaps) {
+    heap_build(this->events, heap, this->position);
+  }
+}
+
+const Event &PartitionedEventHeap::top() const {
+  int p = top_partition();
+  return p < 0 ? no_event : this->events[this->heaps[p][0]];
+}
+
+int PartitionedEventHeap::top_index() const {
+  int p = top_partition();
+  return p < 0 ? -1 : this->heaps[p][0];
+}
+
+bool PartitionedEventHeap::empty() const {
+  return std::isinf(top().time);
+}
+
+void PartitionedEventHeap::move(int i, int p) {
+  if (get_partition(i) == p) {
+    return;
+  }
+
+  // take i out of its heap by putting the last node in its place
+  std::vector<int> &from = this->heaps[get_partition(i)];
+  int pos = this->position[i];
+  heap_swap_nodes(from, this->position, pos, (int)from.size() - 1);
+  from.pop_back();
+  if (pos < (int)from.size()) {
+    int moved = from[pos];
+    heap_sift_up(this->events, from, this->position, pos);
+    heap_sift_down(this->events, from, this->position, this->position[moved]);
+  }
+
+  std::vector<int> &to = this->heaps[p];
+  this->owner[i].store(p, std::memory_order_relaxed);
+  this->position[i] = (int)to.size();
+  to.push_back(i);
+  heap_sift_up(this->events, to, this->position, this->position[i]);
+}
+
+int PartitionedEventHeap::top_partition() const {
+  int top = -1;
+  for (int p = 0; p < (int)this->heaps.size(); p++) {
+    if (this->heaps[p].empty()) {
+      continue;
+    }
+    if (top < 0 || this->events[this->heaps[p][0]].time <
+                       this->events[this->heaps[top][0]].time) {
+      top = p;
+    }
+  }
+  return top;
+}
+
+const Event &PartitionedEventHeap::Partition::top() const {
+  const std::vector<int> &heap = this->queue->heaps[this->p];
+  return heap.empty() ? no_event : this->queue->events[heap[0]];
+}
+
+int PartitionedEventHeap::Partition::top_index() const {
+  const std::vector<int> &heap = this->queue->heaps[this->p];
+  return heap.empty() ? -1 : heap[0];
+}
+
+bool PartitionedEventHeap::Partition::empty() const {
+  return std::isinf(top().time);
+}
@@ -1,164 +1,436 @@
 #include <random>
 #include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include <utility>
 #include <vector>
 
+#include "Philox.h"
 #include "SpatialGrid.h"
 #include "config.h"
+#include "parallel.h"
 #include "vec3.h"
 #include "Sphere.h"
 
 
-SpatialGrid::SpatialGrid(long double cell_size, int grid_size, int sphere_count, double sphere_radius) {
+template <typename Scalar, int Dim>
+BasicSpatialGrid<Scalar, Dim>::BasicSpatialGrid(Scalar cell_size, int grid_size, int sphere_count, Scalar sphere_radius) {
   std::random_device rd;
-  std::mt19937 gen(rd());
-  std::normal_distribution<long double> normal_dist(0, 1);
-  std::uniform_real_distribution<long double> uniform_dist(0, 1);
+  reset(cell_size, grid_size, sphere_count, sphere_radius, rd());
+}
+
+template <typename Scalar, int Dim>
+BasicSpatialGrid<Scalar, Dim>::BasicSpatialGrid(Scalar cell_size, int grid_size, int sphere_count, Scalar sphere_radius, std::uint64_t seed, int thread_count) {
+  reset(cell_size, grid_size, sphere_count, sphere_radius, seed, thread_count);
+}
 
+template <typename Scalar, int Dim>
+void BasicSpatialGrid<Scalar, Dim>::reset(Scalar cell_size, int grid_size, int sphere_count, Scalar sphere_radius, std::uint64_t seed, int thread_count) {
+  TRACE_PHASE("grid_reset");
   this->cell_size = cell_size;
   this->grid_size = grid_size;
-  this->grid = new GridCell[grid_size * grid_size * grid_size];
   this->sphere_count = sphere_count;
-  this->spheres = new Sphere[this->sphere_count];
-
-  if (this->grid == nullptr) {
-    throw std::bad_alloc();
+  for (int i = 0; i < Dim; i++) {
+    this->strides[i] = i == 0 ? 1 : this->strides[i - 1] * grid_size;
+  }
+  // radius = epsilon/2
+  this->spheres.reset(this->sphere_count, sphere_radius, TORUS_SIZE);
+  this->sphere_cells.assign(this->sphere_count, 0);
+  this->next_in_cell.assign(this->sphere_count, -1);
+  this->prev_in_cell.assign(this->sphere_count, -1);
+  for (auto &sector : grid) {
+    sector.clear();
   }
+  set_sector_count(1);
+  this->sphere_index.resize(this->sphere_count);
+  this->original_index.resize(this->sphere_count);
+  std::iota(this->sphere_index.begin(), this->sphere_index.end(), 0);
+  std::iota(this->original_index.begin(), this->original_index.end(), 0);
 
-  for (int i = 0; i < this->sphere_count; i++) {
-    point3 center{};
-    vec3 velocity{};
+  // every sphere draws from a stream of its own, so the threads can split
+  // them up any way and still place them all the same
+  parallel_for(this->sphere_count, thread_count, [&](int, int begin, int end) {
+    TRACE_PHASE("draw_spheres");
+    for (int i = begin; i < end; i++) {
+      basic_point3<Scalar, Dim> center;
+      basic_vec3<Scalar, Dim> velocity;
+      draw_sphere<Scalar, Dim>(seed, i, center, velocity);
 
-    for (int j = 0; j < DIMENSIONS; j++) {
-      center[j] = uniform_dist(gen);
-      velocity[j] = normal_dist(gen);
+      this->spheres.set_center(i, center);
+      this->spheres.set_velocity(i, velocity);
+      this->sphere_cells[i] = get_cell_index(center);
     }
+  });
 
-    velocity.normalize();
-
-    // radius = epsilon/2
-    this->spheres[i] = Sphere(sphere_radius, center, velocity);;
-    add_sphere(&this->spheres[i]);
+  // the cell maps are shared, so spheres are linked in on one thread
+  for (int i = 0; i < this->sphere_count; i++) {
+    link_sphere(i, this->sphere_cells[i]);
   }
 }
 
-SpatialGrid::SpatialGrid(long double cell_size, int grid_size, int sphere_count, Sphere *spheres) {
+template <typename Scalar, int Dim>
+BasicSpatialGrid<Scalar, Dim>::BasicSpatialGrid(Scalar cell_size, int grid_size, int sphere_count, BasicSphere<Dim> *spheres) {
   this->cell_size = cell_size;
   this->grid_size = grid_size;
-  this->grid = new GridCell[grid_size * grid_size * grid_size];
   this->sphere_count = sphere_count;
-  this->spheres = spheres;
-
-  if (this->grid == nullptr) {
-    throw std::bad_alloc();
+  for (int i = 0; i < Dim; i++) {
+    this->strides[i] = i == 0 ? 1 : this->strides[i - 1] * grid_size;
   }
+  this->spheres = BasicSphereStore<Scalar, Dim>(this->sphere_count, spheres, TORUS_SIZE);
+  this->sphere_cells.assign(this->sphere_count, 0);
+  this->next_in_cell.assign(this->sphere_count, -1);
+  this->prev_in_cell.assign(this->sphere_count, -1);
+  set_sector_count(1);
+  this->sphere_index.resize(this->sphere_count);
+  this->original_index.resize(this->sphere_count);
+  std::iota(this->sphere_index.begin(), this->sphere_index.end(), 0);
+  std::iota(this->original_index.begin(), this->original_index.end(), 0);
+  delete[] spheres;
 
   for (int i = 0; i < this->sphere_count; i++) {
-    add_sphere(&this->spheres[i]);
+    add_sphere(i);
   }
 }
 
-SpatialGrid::~SpatialGrid() {
-  if (this->grid != nullptr) {
-    delete[] this->grid;
-    this->grid = nullptr;
+template <typename Scalar, int Dim>
+void BasicSpatialGrid<Scalar, Dim>::wrap_position(int s) {
+  // spheres can travel more than one torus length between updates now that
+  // they are advanced lazily, so wrap by whole periods
+  for (int i = 0; i < Dim; i++) {
+    Scalar &x = spheres.center(s, i);
+    if (x < 0 || x > TORUS_SIZE) {
+      x -= TORUS_SIZE * std::floor(x / TORUS_SIZE);
+    }
   }
+}
 
-  if (this->spheres != nullptr) {
-    delete[] this->spheres;
-    this->spheres = nullptr;
+template <typename Scalar, int Dim>
+long long BasicSpatialGrid<Scalar, Dim>::get_cell_index(const basic_point3<Scalar, Dim> &p) {
+  long long index = 0;
+  for (int i = 0; i < Dim; i++) {
+    // a coordinate sitting exactly on the far edge belongs to the last cell
+    int cell = std::min((int) (p[i] / cell_size), grid_size - 1);
+    index += cell * strides[i];
   }
+
+  return index;
 }
 
-void SpatialGrid::wrap_position(point3 *p) {
-  for (int i = 0; i < DIMENSIONS; i++) {
-    if ((*p)[i] < MIN_CORNER[i]) {
-      (*p)[i] = MAX_CORNER[i] - (MIN_CORNER[i] - (*p)[i]);
-    } else if ((*p)[i] > MAX_CORNER[i]) {
-      (*p)[i] = MIN_CORNER[i] + ((*p)[i] - MAX_CORNER[i]);
-    }
+template <typename Scalar, int Dim>
+void BasicSpatialGrid<Scalar, Dim>::get_cell_position(long long cell_index, int *cell_pos) {
+  for (int i = 0; i < Dim; i++) {
+    cell_pos[i] = cell_index % grid_size;
+    cell_index /= grid_size;
   }
 }
 
-int SpatialGrid::get_cell_index(const point3 &p) {
-  int index = 0;
-  for (int i = 0; i < DIMENSIONS; i++) {
-    index += (int) (p[i] / cell_size) * pow(grid_size, i);
+template <typename Scalar, int Dim>
+long long BasicSpatialGrid<Scalar, Dim>::get_cell_index(const int *cell_pos) {
+  long long index = 0;
+  for (int i = 0; i < Dim; i++) {
+    // wrap around the torus
+    index += ((cell_pos[i] % grid_size + grid_size) % grid_size) * strides[i];
   }
 
   return index;
 }
 
-void SpatialGrid::add_sphere(Sphere *s) {
-  point3 &center = s->get_center();
-  int cell_index = get_cell_index(center);
-  grid[cell_index].spheres.push_back(s);
+template <typename Scalar, int Dim>
+unsigned long long BasicSpatialGrid<Scalar, Dim>::morton_code(long long cell_index) {
+  int cell_pos[Dim];
+  get_cell_position(cell_index, cell_pos);
+
+  unsigned long long code = 0;
+  for (int bit = 0; bit < 64 / Dim; bit++) {
+    for (int i = 0; i < Dim; i++) {
+      code |= (unsigned long long) ((cell_pos[i] >> bit) & 1) << (bit * Dim + i);
+    }
+  }
+
+  return code;
+}
+
+template <typename Scalar, int Dim>
+GridCell *BasicSpatialGrid<Scalar, Dim>::find_cell(long long cell_index) {
+  auto &cells = cells_of(cell_index);
+  auto it = cells.find(cell_index);
+  return it == cells.end() ? nullptr : &it->second;
 }
 
-void SpatialGrid::update_sphere(const point3 &old_pos, Sphere *s) {
-  int old_cell_index = get_cell_index(old_pos);
-  int new_cell_index = get_cell_index(s->get_center());
+template <typename Scalar, int Dim>
+int BasicSpatialGrid<Scalar, Dim>::set_sector_count(int count) {
+  count = std::max(1, std::min(count, grid_size / 3));
 
-  if (old_cell_index != new_cell_index) {
-    // remove sphere from old cell. This is a linear search
-    auto &old_cell = grid[old_cell_index].spheres;
-    auto it = std::find(old_cell.begin(), old_cell.end(), s);
-    if (it != old_cell.end()) {
-        old_cell.erase(it);
+  this->column_sector.resize(grid_size);
+  this->border_column.resize(grid_size);
+  for (int x = 0; x < grid_size; x++) {
+    this->column_sector[x] = (int) ((long long) x * count / grid_size);
+  }
+  for (int x = 0; x < grid_size; x++) {
+    int before = this->column_sector[(x + grid_size - 1) % grid_size];
+    int after = this->column_sector[(x + 1) % grid_size];
+    this->border_column[x] = before != this->column_sector[x] ||
+                             after != this->column_sector[x];
+  }
+
+  // a single sector keeps its map, so its buckets survive a reset
+  if (count == 1 && grid.size() == 1) {
+    this->sector_count = count;
+    return count;
+  }
+
+  // hand the cells over to the maps of their new sectors
+  std::vector<std::unordered_map<long long, GridCell>> cells(count);
+  for (auto &sector : grid) {
+    for (auto &cell : sector) {
+      cells[this->column_sector[cell.first % grid_size]].insert(cell);
     }
+  }
+  this->grid.swap(cells);
+  this->sector_count = count;
 
-    // add sphere to new cell
-    grid[new_cell_index].spheres.push_back(s);
+  return count;
+}
+
+template <typename Scalar, int Dim>
+bool BasicSpatialGrid<Scalar, Dim>::in_sector_interior(int s, int margin) const {
+  int x = sphere_cells[s] % grid_size;
+  for (int k = -margin; k <= margin; k++) {
+    int column = ((x + k) % grid_size + grid_size) % grid_size;
+    if (this->column_sector[column] != this->column_sector[x] ||
+        this->border_column[column]) {
+      return false;
+    }
   }
+  return true;
 }
 
-std::vector<Sphere *> SpatialGrid::get_nearby_spheres(Sphere *s) {
-  std::vector<Sphere *> nearby_spheres;
-  point3 &center = s->get_center();
-  int cell_index = get_cell_index(center);
+template <typename Scalar, int Dim>
+typename BasicSpatialGrid<Scalar, Dim>::SphereState BasicSpatialGrid<Scalar, Dim>::save_sphere(int s) const {
+  return {spheres.get_state(s), sphere_cells[s]};
+}
 
-  // get spheres from the same cell
-  nearby_spheres.insert(nearby_spheres.end(), grid[cell_index].spheres.begin(),
-                        grid[cell_index].spheres.end());
+template <typename Scalar, int Dim>
+void BasicSpatialGrid<Scalar, Dim>::restore_sphere(int s, const SphereState &saved) {
+  move_sphere(s, saved.cell);
+  spheres.set_state(s, saved.state);
+}
 
-  // get spheres from neighboring cells
-  std::vector<GridCell *> nearby_cells = get_nearby_cells(cell_index);
-  for (auto &cell : nearby_cells) {
-    nearby_spheres.insert(nearby_spheres.end(), cell->spheres.begin(),
-                          cell->spheres.end());
+template <typename Scalar, int Dim>
+size_t BasicSpatialGrid<Scalar, Dim>::get_occupied_cell_count() const {
+  size_t count = 0;
+  for (const auto &sector : grid) {
+    count += sector.size();
   }
+  return count;
+}
 
-  return nearby_spheres;
+template <typename Scalar, int Dim>
+void BasicSpatialGrid<Scalar, Dim>::add_sphere(int s) {
+  link_sphere(s, get_cell_index(spheres.get_center(s)));
+}
+
+template <typename Scalar, int Dim>
+void BasicSpatialGrid<Scalar, Dim>::move_sphere(int s, long long new_cell_index) {
+  if (sphere_cells[s] != new_cell_index) {
+    unlink_sphere(s);
+    link_sphere(s, new_cell_index);
+  }
 }
 
-std::vector<GridCell *> SpatialGrid::get_nearby_cells(int cell_index) {
-  std::vector<GridCell *> nearby_cells;
-  point3 cell_pos{};
-  for (int i = 0; i < DIMENSIONS; i++) {
-    cell_pos[i] = (cell_index / (int) pow(grid_size, i)) % grid_size;
+template <typename Scalar, int Dim>
+void BasicSpatialGrid<Scalar, Dim>::link_sphere(int s, long long cell_index) {
+  GridCell &cell = cells_of(cell_index)[cell_index];
+  next_in_cell[s] = cell.head;
+  prev_in_cell[s] = -1;
+  if (cell.head >= 0) {
+    prev_in_cell[cell.head] = s;
   }
+  cell.head = s;
+  sphere_cells[s] = cell_index;
+}
+
+template <typename Scalar, int Dim>
+void BasicSpatialGrid<Scalar, Dim>::unlink_sphere(int s) {
+  long long cell_index = sphere_cells[s];
+  int next = next_in_cell[s];
+  int prev = prev_in_cell[s];
 
-  for (int i = 0; i < pow(3, DIMENSIONS); i++) {
-    // get the position of the neighboring cell
-    point3 neighbor_pos = cell_pos;
-    for (int j = 0; j < DIMENSIONS; j++) {
-      int offset = (i / (int) pow(3, j)) % 3 - 1;
-      neighbor_pos[j] += offset;
+  if (next >= 0) {
+    prev_in_cell[next] = prev;
+  }
+  if (prev >= 0) {
+    next_in_cell[prev] = next;
+  } else {
+    auto &cells = cells_of(cell_index);
+    GridCell &cell = cells[cell_index];
+    cell.head = next;
+    // only occupied cells are stored
+    if (cell.head < 0) {
+      cells.erase(cell_index);
     }
+  }
 
-    wrap_position(&neighbor_pos);
-    int neighbor_index = get_cell_index(neighbor_pos);
-    nearby_cells.push_back(&grid[neighbor_index]);
+  next_in_cell[s] = -1;
+  prev_in_cell[s] = -1;
+}
+
+template <typename Scalar, int Dim>
+std::vector<int> BasicSpatialGrid<Scalar, Dim>::reorder() {
+  TRACE_PHASE("reorder");
+  // ties keep their current order, so reordering twice changes nothing
+  std::vector<std::pair<unsigned long long, int>> keys(this->sphere_count);
+  for (int i = 0; i < this->sphere_count; i++) {
+    keys[i] = {morton_code(sphere_cells[i]), i};
+  }
+  std::sort(keys.begin(), keys.end());
+
+  std::vector<int> order(this->sphere_count);
+  std::vector<long long> cells(this->sphere_count);
+  std::vector<int> originals(this->sphere_count);
+  for (int i = 0; i < this->sphere_count; i++) {
+    order[i] = keys[i].second;
+    cells[i] = sphere_cells[order[i]];
+    originals[i] = original_index[order[i]];
+    sphere_index[originals[i]] = i;
+  }
+  spheres.permute(order);
+  sphere_cells.swap(cells);
+  original_index.swap(originals);
+
+  // relink every cell, back to front so the lists run in index order
+  for (auto &sector : grid) {
+    for (auto &cell : sector) {
+      cell.second.head = -1;
+    }
+  }
+  for (int i = this->sphere_count - 1; i >= 0; i--) {
+    link_sphere(i, sphere_cells[i]);
+  }
+
+  return order;
+}
+
+template <typename Scalar, int Dim>
+std::vector<int> BasicSpatialGrid<Scalar, Dim>::get_nearby_spheres(int s) {
+  std::vector<int> nearby_spheres;
+  for_each_nearby_sphere(s, [&](int other) { nearby_spheres.push_back(other); });
+  return nearby_spheres;
+}
+
+template <typename Scalar, int Dim>
+void BasicSpatialGrid<Scalar, Dim>::get_nearby_candidates(int s, CandidateBlock<Scalar, Dim> &block, SimulationStats *stats) {
+  TRACE_SCOPE("gather_neighbors");
+  block.clear();
+  for_each_nearby_sphere(s, [&](int other) {
+    COUNT_STAT(if (stats != nullptr) { stats->candidate_pairs++; })
+    pack_candidate(s, other, block);
+  }, stats);
+}
+
+template <typename Scalar, int Dim>
+void BasicSpatialGrid<Scalar, Dim>::pack_candidate(int s, int other, CandidateBlock<Scalar, Dim> &block) {
+  // collide would reject these anyway
+  if (other == s || spheres.collision_checks(other) <= 0) {
+    return;
+  }
+
+  Scalar center[Dim];
+  Scalar velocity[Dim];
+  Scalar dt = spheres.time(s) - spheres.time(other);
+  for (int i = 0; i < Dim; i++) {
+    velocity[i] = spheres.velocity(other, i);
+    center[i] = spheres.center(other, i) + velocity[i] * dt;
   }
+  block.push_back(other, center, velocity, spheres.radius(other));
+}
 
-  return nearby_cells;
+template <typename Scalar, int Dim>
+void BasicSpatialGrid<Scalar, Dim>::pack_candidates(int s, const std::vector<int> &others, CandidateBlock<Scalar, Dim> &block) {
+  block.clear();
+  for (int other : others) {
+    pack_candidate(s, other, block);
+  }
 }
 
-void SpatialGrid::update_positions(long double dt) {
+template <typename Scalar, int Dim>
+void BasicSpatialGrid<Scalar, Dim>::advance_sphere(int s, Scalar t) {
+  TRACE_SCOPE("advance_sphere");
+  spheres.advance_to(s, t);
+  wrap_position(s);
+}
+
+template <typename Scalar, int Dim>
+void BasicSpatialGrid<Scalar, Dim>::synchronize(Scalar t) {
+  TRACE_PHASE("synchronize");
   for (int i = 0; i < this->sphere_count; i++) {
-    Sphere *s = &this->spheres[i];
-    point3 old_pos = s->get_center();
-    s->update_position(dt);
-    wrap_position(&s->get_center());
-    update_sphere(old_pos, s);
+    advance_sphere(i, t);
+  }
+}
+
+template <typename Scalar, int Dim>
+void BasicSpatialGrid<Scalar, Dim>::exit_times(int s, Scalar *times) {
+  int cell_pos[Dim];
+  get_cell_position(sphere_cells[s], cell_pos);
+
+  for (int i = 0; i < Dim; i++) {
+    // position relative to the lower wall of the registered cell. measuring
+    // from the nearest image of the cell centre keeps spheres that were
+    // wrapped onto the other side of the torus (or rounded just past a wall)
+    // measured against their own cell.
+    Scalar x = spheres.center(s, i) - (cell_pos[i] + 0.5) * cell_size;
+    x -= TORUS_SIZE * std::floor(x / TORUS_SIZE + 0.5);
+    x += cell_size / 2;
+
+    Scalar velocity = spheres.velocity(s, i);
+    if (velocity > 0) {
+      times[i] = std::max((cell_size - x) / velocity, Scalar(0));
+    } else if (velocity < 0) {
+      times[i] = std::max(x / -velocity, Scalar(0));
+    } else {
+      times[i] = std::numeric_limits<Scalar>::infinity();
+    }
   }
-}
\ No newline at end of file
+}
+
+template <typename Scalar, int Dim>
+Scalar BasicSpatialGrid<Scalar, Dim>::time_to_transfer(int s) {
+  Scalar times[Dim];
+  exit_times(s, times);
+  return *std::min_element(times, times + Dim);
+}
+
+template <typename Scalar, int Dim>
+int BasicSpatialGrid<Scalar, Dim>::move_to_next_cell(int s, int &direction) {
+  Scalar times[Dim];
+  exit_times(s, times);
+  int axis = std::min_element(times, times + Dim) - times;
+  direction = spheres.velocity(s, axis) > 0 ? 1 : -1;
+
+  // move the sphere into the neighbouring cell along axis
+  int cell_pos[Dim];
+  get_cell_position(sphere_cells[s], cell_pos);
+  cell_pos[axis] += direction;
+  move_sphere(s, get_cell_index(cell_pos));
+
+  return axis;
+}
+
+template <typename Scalar, int Dim>
+std::vector<int> BasicSpatialGrid<Scalar, Dim>::transfer_sphere(int s) {
+  std::vector<int> new_neighbors;
+  transfer_sphere(s, [&](int other) { new_neighbors.push_back(other); });
+  return new_neighbors;
+}
+
+template class BasicSpatialGrid<float, 2>;
+template class BasicSpatialGrid<float, 3>;
+template class BasicSpatialGrid<float, 4>;
+template class BasicSpatialGrid<double, 2>;
+template class BasicSpatialGrid<double, 3>;
+template class BasicSpatialGrid<double, 4>;
+template class BasicSpatialGrid<long double, 2>;
+template class BasicSpatialGrid<long double, 3>;
+template class BasicSpatialGrid<long double, 4>;
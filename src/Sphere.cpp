@@ -3,13 +3,16 @@
 #include "Sphere.h"
 #include "vec3.h"
 
-double collide(const Sphere* s1, const Sphere* s2) {
+template <int Dim>
+double collide(const BasicSphere<Dim>* s1, const BasicSphere<Dim>* s2) {
+    using vec = typename BasicSphere<Dim>::vec;
+
     if (s1->max_collision_checks <= 0 || s2->max_collision_checks <= 0) {
         return -1;
     }
 
-    vec3 relative_velocity = s2->velocity - s1->velocity;
-    vec3 relative_position = s2->center - s1->center;
+    vec relative_velocity = s2->velocity - s1->velocity;
+    vec relative_position = s2->center - s1->center;
 
     double combined_radius = s1->radius + s2->radius;
 
@@ -34,10 +37,13 @@ double collide(const Sphere* s1, const Sphere* s2) {
     return -1;
 }
 
-void resolve_collision(Sphere* s1, Sphere* s2) {
-    vec3 normal = s2->center - s1->center;
+template <int Dim>
+void resolve_collision(BasicSphere<Dim>* s1, BasicSphere<Dim>* s2) {
+    using vec = typename BasicSphere<Dim>::vec;
+
+    vec normal = s2->center - s1->center;
     normal.normalize();
-    vec3 relative_velocity = s1->velocity - s2->velocity;
+    vec relative_velocity = s1->velocity - s2->velocity;
 
     double velocity_along_normal = relative_velocity.dot(normal);
 
@@ -48,11 +54,36 @@ void resolve_collision(Sphere* s1, Sphere* s2) {
     //     return;
     // }
 
-    vec3 impulse = velocity_along_normal * normal;
+    vec impulse = velocity_along_normal * normal;
     s1->velocity -= impulse;
     s2->velocity += impulse;
+
+    s1->collision_count++;
+    s2->collision_count++;
 }
 
-void Sphere::update_position(long double dt) {
+template <int Dim>
+void BasicSphere<Dim>::update_position(long double dt) {
     center += velocity * dt;
-}
\ No newline at end of file
+    time += dt;
+}
+
+template <int Dim>
+void BasicSphere<Dim>::advance_to(long double t) {
+    if (t != time) {
+        update_position(t - time);
+        time = t;
+    }
+}
+
+template class BasicSphere<2>;
+template class BasicSphere<3>;
+template class BasicSphere<4>;
+
+template double collide(const BasicSphere<2> *, const BasicSphere<2> *);
+template double collide(const BasicSphere<3> *, const BasicSphere<3> *);
+template double collide(const BasicSphere<4> *, const BasicSphere<4> *);
+
+template void resolve_collision(BasicSphere<2> *, BasicSphere<2> *);
+template void resolve_collision(BasicSphere<3> *, BasicSphere<3> *);
+template void resolve_collision(BasicSphere<4> *, BasicSphere<4> *);
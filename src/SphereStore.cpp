@@ -0,0 +1,266 @@
+#include <cmath>
+#include <vector>
+
+#include "SphereStore.h"
+#include "config.h"
+#include "vec3.h"
+
+template <typename Scalar, int Dim>
+BasicSphereStore<Scalar, Dim>::BasicSphereStore(int count, Scalar radius,
+                                                Scalar torus_size) {
+  reset(count, radius, torus_size);
+}
+
+template <typename Scalar, int Dim>
+void BasicSphereStore<Scalar, Dim>::reset(int count, Scalar radius,
+                                          Scalar torus_size) {
+  this->count = count;
+  this->torus_size = torus_size;
+  this->shared_radius = std::fmax(Scalar(0), radius);
+  for (int d = 0; d < Dim; d++) {
+    this->centers[d].assign(count, 0);
+    this->velocities[d].assign(count, 0);
+  }
+  this->times.assign(count, 0);
+  this->collision_counts.assign(count, 0);
+  this->collision_checks_left.assign(count, MAX_COLLISIONS_CHECKS);
+  this->radii.clear();
+  this->ids.resize(count);
+
+  for (int i = 0; i < count; i++) {
+    this->ids[i] = UUID().id;
+  }
+}
+
+template <typename Scalar, int Dim>
+BasicSphereStore<Scalar, Dim>::BasicSphereStore(int count,
+                                                BasicSphere<Dim> *spheres,
+                                                Scalar torus_size)
+    : BasicSphereStore(count, count > 0 ? spheres[0].get_radius() : 0,
+                       torus_size) {
+  for (int i = 0; i < count; i++) {
+    BasicSphere<Dim> &s = spheres[i];
+    this->set_center(i, s.get_center().template cast<Scalar>());
+    this->set_velocity(i, s.get_velocity().template cast<Scalar>());
+    this->times[i] = s.get_time();
+    this->collision_counts[i] = s.get_collision_count();
+    this->collision_checks_left[i] = s.get_max_collision_checks();
+    this->ids[i] = s.get_id();
+
+    // only keep a radius per sphere if they are not all the same
+    Scalar radius = s.get_radius();
+    if (this->radii.empty() && radius != this->shared_radius) {
+      this->radii.assign(count, this->shared_radius);
+    }
+    if (!this->radii.empty()) {
+      this->radii[i] = radius;
+    }
+  }
+}
+
+template <typename Scalar, int Dim>
+basic_point3<Scalar, Dim>
+BasicSphereStore<Scalar, Dim>::get_center(int i) const {
+  basic_point3<Scalar, Dim> p;
+  for (int d = 0; d < Dim; d++) {
+    p[d] = this->centers[d][i];
+  }
+  return p;
+}
+
+template <typename Scalar, int Dim>
+basic_vec3<Scalar, Dim>
+BasicSphereStore<Scalar, Dim>::get_velocity(int i) const {
+  basic_vec3<Scalar, Dim> v;
+  for (int d = 0; d < Dim; d++) {
+    v[d] = this->velocities[d][i];
+  }
+  return v;
+}
+
+template <typename Scalar, int Dim>
+void BasicSphereStore<Scalar, Dim>::set_center(
+    int i, const basic_point3<Scalar, Dim> &p) {
+  for (int d = 0; d < Dim; d++) {
+    this->centers[d][i] = p[d];
+  }
+}
+
+template <typename Scalar, int Dim>
+void BasicSphereStore<Scalar, Dim>::set_velocity(
+    int i, const basic_vec3<Scalar, Dim> &v) {
+  for (int d = 0; d < Dim; d++) {
+    this->velocities[d][i] = v[d];
+  }
+}
+
+template <typename Scalar, int Dim>
+void BasicSphereStore<Scalar, Dim>::advance_to(int i, Scalar t) {
+  Scalar dt = t - this->times[i];
+  if (dt != 0) {
+    for (int d = 0; d < Dim; d++) {
+      this->centers[d][i] += this->velocities[d][i] * dt;
+    }
+    this->times[i] = t;
+  }
+}
+
+template <typename Scalar, int Dim>
+typename BasicSphereStore<Scalar, Dim>::State
+BasicSphereStore<Scalar, Dim>::get_state(int i) const {
+  State state;
+  for (int d = 0; d < Dim; d++) {
+    state.center[d] = this->centers[d][i];
+    state.velocity[d] = this->velocities[d][i];
+  }
+  state.time = this->times[i];
+  state.collision_count = this->collision_counts[i];
+  state.collision_checks = this->collision_checks_left[i];
+  return state;
+}
+
+template <typename Scalar, int Dim>
+void BasicSphereStore<Scalar, Dim>::set_state(int i, const State &state) {
+  for (int d = 0; d < Dim; d++) {
+    this->centers[d][i] = state.center[d];
+    this->velocities[d][i] = state.velocity[d];
+  }
+  this->times[i] = state.time;
+  this->collision_counts[i] = state.collision_count;
+  this->collision_checks_left[i] = state.collision_checks;
+}
+
+namespace {
+
+// out[i] = values[order[i]], swapped back into values
+template <typename T>
+void permute_vector(std::vector<T> &values, const std::vector<int> &order) {
+  std::vector<T> out(order.size());
+  for (size_t i = 0; i < order.size(); i++) {
+    out[i] = values[order[i]];
+  }
+  values.swap(out);
+}
+
+} // namespace
+
+template <typename Scalar, int Dim>
+void BasicSphereStore<Scalar, Dim>::permute(const std::vector<int> &order) {
+  for (int d = 0; d < Dim; d++) {
+    permute_vector(this->centers[d], order);
+    permute_vector(this->velocities[d], order);
+  }
+  permute_vector(this->times, order);
+  permute_vector(this->collision_counts, order);
+  permute_vector(this->collision_checks_left, order);
+  if (!this->radii.empty()) {
+    permute_vector(this->radii, order);
+  }
+  permute_vector(this->ids, order);
+}
+
+template <typename Scalar, int Dim>
+BasicSphere<Dim> BasicSphereStore<Scalar, Dim>::get_sphere(int i) const {
+  BasicSphere<Dim> s(this->radius(i),
+                     this->get_center(i).template cast<long double>(),
+                     this->get_velocity(i).template cast<long double>());
+  s.set_time(this->times[i]);
+  s.set_collision_count(this->collision_counts[i]);
+  s.set_max_collision_checks(this->collision_checks_left[i]);
+  s.set_id(this->ids[i]);
+  return s;
+}
+
+template <typename Scalar, int Dim>
+Scalar collide(const BasicSphereStore<Scalar, Dim> &spheres, int i, int j) {
+  if (spheres.collision_checks_left[i] <= 0 ||
+      spheres.collision_checks_left[j] <= 0) {
+    return -1;
+  }
+
+  // project the sphere with the older clock forward to the newer one
+  Scalar t = std::fmax(spheres.times[i], spheres.times[j]);
+  Scalar dti = t - spheres.times[i];
+  Scalar dtj = t - spheres.times[j];
+  Scalar L = spheres.torus_size;
+
+  Scalar vv = 0, vx = 0, xx = 0;
+  for (int d = 0; d < Dim; d++) {
+    Scalar v = spheres.velocities[d][j] - spheres.velocities[d][i];
+    Scalar x = (spheres.centers[d][j] + spheres.velocities[d][j] * dtj) -
+               (spheres.centers[d][i] + spheres.velocities[d][i] * dti);
+    // nearest image of j
+    if (L > 0) {
+      x -= L * std::floor(x / L + Scalar(0.5));
+    }
+    vv += v * v;
+    vx += v * x;
+    xx += x * x;
+  }
+
+  Scalar combined_radius = spheres.radius(i) + spheres.radius(j);
+
+  Scalar a = vv;
+  Scalar b = 2 * vx;
+  Scalar c = xx - combined_radius * combined_radius;
+
+  Scalar discriminant = b * b - 4 * a * c;
+
+  if (discriminant < 0) {
+    // No real roots, so no collision
+    return -1;
+  }
+
+  Scalar t1 = (-b - std::sqrt(discriminant)) / (2 * a);
+  if (t1 >= 0) {
+    return t1;
+  }
+  return -1;
+}
+
+template <typename Scalar, int Dim>
+void resolve_collision(BasicSphereStore<Scalar, Dim> &spheres, int i, int j) {
+  Scalar L = spheres.torus_size;
+  Scalar normal[Dim];
+  Scalar length = 0;
+
+  for (int d = 0; d < Dim; d++) {
+    normal[d] = spheres.centers[d][j] - spheres.centers[d][i];
+    if (L > 0) {
+      normal[d] -= L * std::floor(normal[d] / L + Scalar(0.5));
+    }
+    length += normal[d] * normal[d];
+  }
+  length = std::sqrt(length);
+
+  Scalar velocity_along_normal = 0;
+  for (int d = 0; d < Dim; d++) {
+    normal[d] /= length;
+    velocity_along_normal +=
+        (spheres.velocities[d][i] - spheres.velocities[d][j]) * normal[d];
+  }
+
+  for (int d = 0; d < Dim; d++) {
+    Scalar impulse = velocity_along_normal * normal[d];
+    spheres.velocities[d][i] -= impulse;
+    spheres.velocities[d][j] += impulse;
+  }
+
+  spheres.collision_counts[i]++;
+  spheres.collision_counts[j]++;
+}
+
+#define INSTANTIATE_SPHERE_STORE(Scalar, Dim)                                 \
+  template class BasicSphereStore<Scalar, Dim>;                                \
+  template Scalar collide(const BasicSphereStore<Scalar, Dim> &, int, int);    \
+  template void resolve_collision(BasicSphereStore<Scalar, Dim> &, int, int);
+
+INSTANTIATE_SPHERE_STORE(float, 2)
+INSTANTIATE_SPHERE_STORE(float, 3)
+INSTANTIATE_SPHERE_STORE(float, 4)
+INSTANTIATE_SPHERE_STORE(double, 2)
+INSTANTIATE_SPHERE_STORE(double, 3)
+INSTANTIATE_SPHERE_STORE(double, 4)
+INSTANTIATE_SPHERE_STORE(long double, 2)
+INSTANTIATE_SPHERE_STORE(long double, 3)
+INSTANTIATE_SPHERE_STORE(long double, 4)
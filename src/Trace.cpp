@@ -0,0 +1,91 @@
+#include <algorithm>
+#include <ios>
+#include <memory>
+#include <mutex>
+#include <ostream>
+
+#include "Trace.h"
+
+Tracer Tracer::instance;
+
+void Tracer::start(int sampling) {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  for (std::unique_ptr<Thread> &thread : this->threads) {
+    thread->spans.clear();
+    thread->skip = 0;
+  }
+  this->sampling = std::max(1, sampling);
+  this->origin = std::chrono::steady_clock::now();
+  this->recording.store(true, std::memory_order_relaxed);
+}
+
+long Tracer::size() const {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  long spans = 0;
+  for (const std::unique_ptr<Thread> &thread : this->threads) {
+    spans += (long)thread->spans.size();
+  }
+  return spans;
+}
+
+Tracer::Thread *Tracer::acquire() {
+  struct Handle {
+    Thread *thread = nullptr;
+    ~Handle() {
+      Tracer::get().release(this->thread);
+      current_thread() = nullptr;
+    }
+  };
+  thread_local Handle handle;
+
+  std::lock_guard<std::mutex> lock(this->mutex);
+  if (this->free_threads.empty()) {
+    this->threads.push_back(std::unique_ptr<Thread>(new Thread()));
+    this->threads.back()->id = (int)this->threads.size() - 1;
+    handle.thread = this->threads.back().get();
+    return handle.thread;
+  }
+
+  auto lowest = std::min_element(
+      this->free_threads.begin(), this->free_threads.end(),
+      [](const Thread *a, const Thread *b) { return a->id < b->id; });
+  handle.thread = *lowest;
+  this->free_threads.erase(lowest);
+  return handle.thread;
+}
+
+void Tracer::release(Thread *thread) {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  thread->sampled_depth = 0;
+  this->free_threads.push_back(thread);
+}
+
+void Tracer::write_json(std::ostream &out) const {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  std::ios_base::fmtflags flags = out.flags();
+  std::streamsize precision = out.precision();
+  out.setf(std::ios_base::fixed, std::ios_base::floatfield);
+  out.precision(3);
+
+  out << "{\"displayTimeUnit\": \"ns\", \"otherData\": {\"sampling\": "
+      << this->sampling << "},\n\"traceEvents\": [";
+  bool first = true;
+  for (const std::unique_ptr<Thread> &thread : this->threads) {
+    out << (first ? "\n" : ",\n")
+        << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": "
+        << thread->id << ", \"args\": {\"name\": \"thread " << thread->id
+        << "\"}}";
+    first = false;
+
+    for (const Thread::Span &span : thread->spans) {
+      out << ",\n{\"name\": \"" << span.name
+          << "\", \"cat\": \"spheresim\", \"ph\": \"X\", \"ts\": " << span.start
+          << ", \"dur\": " << span.duration << ", \"pid\": 1, \"tid\": "
+          << thread->id << "}";
+    }
+  }
+  out << "\n]}\n";
+
+  out.flags(flags);
+  out.precision(precision);
+}
@@ -1,8 +1,10 @@
 #include <SFML/Graphics.hpp>
+#include <cstdint>
 #include <fstream>
 #include <iostream>
 #include <vector>
 
+#include "Ensemble.h"
 #include "sphere_simulation.h"
 #include "vec3.h"
 
@@ -55,12 +57,27 @@ void run_simulation(int n) {
   write_data_to_csv(collision_times, "collision_times.csv");
 }
 
+/**
+ * Runs replicas of the simulation side by side in one process, one per
+ * hardware thread at a time, and writes each of them as a line of the csv.
+ * the same seed gives the same lines.
+ */
+void run_ensemble(int n, int replicas, std::uint64_t seed) {
+  Ensemble ensemble(n, replicas, seed);
+  ensemble.run();
+
+  for (int r = 0; r < ensemble.get_replica_count(); r++) {
+    write_data_to_csv(ensemble.get_collision_times(r), "collision_times.csv");
+  }
+}
+
 
 /**
  * Debugging code to test if the simulation is working correctly.
 */
 int main() {
   // run_simulation(10000);
+  // run_ensemble(10000, 1000, 0);
   std::cout << "Starting simulation" << std::endl;
 
   sphere_simulation simulation(1000);
@@ -1,17 +1,25 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
 #include <limits>
 #include <random>
 #include <vector>
 
+#include "Philox.h"
 #include "config.h"
+#include "parallel.h"
 #include "sphere_simulation.h"
 #include "vec3.h"
 
-sphere_simulation::sphere_simulation(int n) {
-  std::random_device rd;
-  std::mt19937 gen(rd());
+sphere_simulation::sphere_simulation(int n, QueueType queue_type)
+    : sphere_simulation(n, std::random_device()(), queue_type) {}
+
+sphere_simulation::sphere_simulation(int n, std::uint64_t seed,
+                                     QueueType queue_type, int thread_count)
+    : thread_count(thread_count) {
+  // the spheres themselves take the streams from 0 up
+  PhiloxStream gen(seed, std::numeric_limits<std::uint64_t>::max());
   std::poisson_distribution<int> poisson_dist(n);
-  std::normal_distribution<long double> normal_dist(0, 1);
-  std::uniform_real_distribution<long double> uniform_dist(0, 1);
 
   // Generate a random number from the Poisson distribution
   this->number_of_spheres = poisson_dist(gen);
@@ -21,7 +29,7 @@ sphere_simulation::sphere_simulation(int n) {
 
   // data structures
   this->collision_times = std::vector<long double>();
-  this->event_queue = std::priority_queue<Event>();
+  this->event_queue = make_event_queue(queue_type, this->number_of_spheres);
   this->spheres = new Sphere[this->number_of_spheres];
 
   if (this->spheres == nullptr) {
@@ -31,32 +39,41 @@ sphere_simulation::sphere_simulation(int n) {
   this->epsilon =
       pow(this->torus_size, DIMENSIONS) / pow(n, 1 / (double)(DIMENSIONS - 1));
 
-  // Generate n spheres
-  for (int i = 0; i < this->number_of_spheres; i++) {
-    point3 center{};
-    vec3 velocity{};
-
-    for (int j = 0; j < DIMENSIONS; j++) {
-      center[j] = uniform_dist(gen);
-      velocity[j] = normal_dist(gen);
-    }
-
-    velocity.normalize();
-
-    // radius = epsilon/2
-    this->spheres[i] = Sphere(epsilon / 2.0, center, velocity);
-  }
+  // Generate n spheres, each from a stream of its own
+  parallel_for(this->number_of_spheres, this->thread_count,
+               [&](int, int begin, int end) {
+                 for (int i = begin; i < end; i++) {
+                   point3 center;
+                   vec3 velocity;
+                   draw_sphere<long double, DIMENSIONS>(seed, i, center,
+                                                        velocity);
+
+                   // radius = epsilon/2
+                   this->spheres[i] = Sphere(epsilon / 2.0, center, velocity);
+                   // not the next free id, which depends on the threads
+                   this->spheres[i].set_id(i);
+                 }
+               });
 }
 
-sphere_simulation::sphere_simulation(int n, Sphere *spheres) {
+sphere_simulation::sphere_simulation(int n, Sphere *spheres,
+                                     QueueType queue_type) {
   this->max_time = MAX_SIMULATION_TIME;
   this->current_time = 0.0;
   this->torus_size = 1.0;
   // data structures
   this->collision_times = std::vector<long double>();
-  this->event_queue = std::priority_queue<Event>();
+  this->event_queue = make_event_queue(queue_type, n);
   this->spheres = spheres;
   this->number_of_spheres = n;
+
+  // the images of a sphere are taken within a diameter of the boundary, as
+  // for the spheres drawn above
+  double radius = 0;
+  for (int i = 0; i < n; i++) {
+    radius = std::max(radius, spheres[i].get_radius());
+  }
+  this->epsilon = 2 * radius;
 }
 
 sphere_simulation::~sphere_simulation() {
@@ -67,96 +84,199 @@ sphere_simulation::~sphere_simulation() {
 }
 
 void sphere_simulation::initialize_events() {
-  for (int i = 0; i < number_of_spheres; i++) {
-    find_collision_events(&spheres[i]);
+  // predicting moves the queried spheres up to the current time, so do that
+  // up front and the threads only have to read them
+  synchronize();
+
+  std::vector<Event> events(number_of_spheres);
+  int threads = std::min(resolve_thread_count(thread_count),
+                         std::max(1, number_of_spheres));
+  std::vector<SimulationStats> thread_stats(threads);
+  parallel_for(number_of_spheres, threads,
+               [&](int thread, int begin, int end) {
+                 CandidateBlock<double> block;
+                 std::vector<double> times;
+                 for (int i = begin; i < end; i++) {
+                   events[i] = predict_next_event(&spheres[i], block, times,
+                                                  thread_stats[thread]);
+                 }
+               });
+
+  // and the queue is built in one go
+  this->event_queue->assign(events);
+
+  for (const SimulationStats &counts : thread_stats) {
+    stats.merge(counts);
   }
+  COUNT_STAT(stats.set_pending(
+      std::count_if(events.begin(), events.end(),
+                    [](const Event &event) { return event.s1 >= 0; })));
 }
 
 void sphere_simulation::run_simulation() {
-  while (!event_queue.empty() && current_time < max_time) {
+  while (!event_queue->empty() && event_queue->top().time < max_time) {
     run_simulation_step();
   }
-  // if there are no more events, update the positions to the max time
+  // if there are no more events, move the clock to the max time
   if (current_time < max_time) {
-    long double dt = max_time - current_time;
-    update_positions(dt);
-
-    for (int i = 0; i < number_of_spheres; i++) {
-      wrap_around(&spheres[i]);
-    }
     current_time = max_time;
   }
+  // bring every sphere up to the final time
+  synchronize();
+
+  if (stats_output != nullptr) {
+    get_stats().write_json(*stats_output);
+  }
 }
 
 void sphere_simulation::run_simulation_step() {
-  Event event = event_queue.top();
-  event_queue.pop();
+  // the event stays in its sphere's slot until handle_event replaces it
+  Event event = event_queue->top();
 
   handle_event(event);
 }
 
 void sphere_simulation::handle_event(Event &event) {
-  // Move to the time of the event
-  update_positions(event.time - current_time);
+  // Move the clock to the time of the event
   current_time = event.time;
-
-  // wrap_around(event.s1);
-  // wrap_around(event.s2);
-
-  // Check if spheres still collide at this time
-  long double collision_time = collide(event.s1, event.s2);
-
-  if (collision_time < 0) {
-    return; // invalidated by previous collision. discard event.
+  events++;
+
+  Sphere *s1 = &spheres[event.s1];
+  Sphere *s2 = &spheres[event.s2];
+
+  // wrap_around(s1);
+  // wrap_around(s2);
+
+  // Check if either sphere has collided since the event was predicted
+  if (event.is_stale(
+          [&](int i) { return spheres[i].get_collision_count(); })) {
+    stale_events++;
+    // invalidated by previous collision. discard event and look for the next
+    // collision of the sphere it belonged to.
+    advance_sphere(s1);
+    find_collision_events(s1);
+    return;
   }
 
-  // Update velocities
-  resolve_collision(event.s1, event.s2);
+  // only the participating spheres are advanced, everyone else keeps their
+  // local clock
+  advance_sphere(s1);
+  advance_sphere(s2);
+
+  // Update velocities. the collision may have been predicted across the
+  // boundary, so resolve it against the nearest image of s1
+  nearest_image(s1, s2);
+  resolve_collision(s1, s2);
+  wrap_around(s1);
 
   // decrement collision checks
-  event.s1->decrement_collision_checks();
-  event.s2->decrement_collision_checks();
+  s1->decrement_collision_checks();
+  s2->decrement_collision_checks();
 
   // Add collision time to the vector
   this->collision_times.push_back(current_time);
 
-  this->find_collision_events(event.s1);
-  this->find_collision_events(event.s2);
+  // replaces the next event of both spheres
+  this->find_collision_events(s1);
+  this->find_collision_events(s2);
 }
 
-void sphere_simulation::update_positions(long double dt) {
+void sphere_simulation::synchronize() {
   for (int i = 0; i < number_of_spheres; i++) {
-    this->spheres[i].update_position(dt);
-    this->wrap_around(&this->spheres[i]);
+    advance_sphere(&this->spheres[i]);
   }
 }
 
-void sphere_simulation::add_collision_event(Sphere *s1, Sphere *s2) {
-  long double collision_time = collide(s1, s2);
+void sphere_simulation::advance_sphere(Sphere *s) {
+  s->advance_to(current_time);
+  wrap_around(s);
+}
 
-  if (collision_time >= 0) {
-    this->event_queue.push(Event(current_time + collision_time, s1, s2));
+void sphere_simulation::find_collision_events(Sphere *s1) {
+  // queried spheres are brought up to the current time first
+  if (s1->get_max_collision_checks() > 0) {
+    for (int j = 0; j < number_of_spheres; j++) {
+      if (s1 != &spheres[j] && spheres[j].get_max_collision_checks() > 0) {
+        advance_sphere(&spheres[j]);
+      }
+    }
   }
+
+  Event event = predict_next_event(s1, candidates, candidate_times, stats);
+  COUNT_STAT(stats.replace_pending(event_queue->get(index_of(s1)).s1 >= 0,
+                                   event.s1 >= 0));
+  this->event_queue->update(index_of(s1), event);
 }
 
-void sphere_simulation::find_collision_events(Sphere *s1) {
-  // Add new events for the affected spheres
-  std::vector<point3> s1_images = get_images(s1);
+Event sphere_simulation::predict_next_event(
+    const Sphere *s1, CandidateBlock<double> &candidates,
+    std::vector<double> &candidate_times,
+    [[maybe_unused]] SimulationStats &stats) const {
+  // only the earliest collision of s1 is kept
+  Event next_event;
 
+  // collide would reject every other sphere
+  if (s1->get_max_collision_checks() <= 0) {
+    return next_event;
+  }
+
+  // the other spheres are packed once for the collision kernel, then tested
+  // against every image of s1
+  candidates.clear();
   for (int j = 0; j < number_of_spheres; j++) {
-    if (s1 == &spheres[j]) {
+    if (s1 == &spheres[j] || spheres[j].get_max_collision_checks() <= 0) {
       continue;
     }
 
-    for (int k = 0; k < s1_images.size(); k++) {
-      s1->set_position(s1_images[k]);
-      add_collision_event(s1, &spheres[j]);
+    double center[DIMENSIONS];
+    double velocity[DIMENSIONS];
+    for (int d = 0; d < DIMENSIONS; d++) {
+      center[d] = spheres[j].get_center()[d];
+      velocity[d] = spheres[j].get_velocity()[d];
+    }
+    candidates.push_back(j, center, velocity, spheres[j].get_radius());
+  }
+
+  std::vector<point3> s1_images = get_images(s1);
+  int n = candidates.size();
+  int images = (int)s1_images.size();
+  candidate_times.resize(images * n);
+  COUNT_STAT(stats.candidate_pairs += n);
+  COUNT_STAT(stats.collide_calls += candidate_times.size());
+
+  double velocity[DIMENSIONS];
+  for (int d = 0; d < DIMENSIONS; d++) {
+    velocity[d] = s1->get_velocity()[d];
+  }
+
+  for (int k = 0; k < images; k++) {
+    double center[DIMENSIONS];
+    for (int d = 0; d < DIMENSIONS; d++) {
+      center[d] = s1_images[k][d];
+    }
+    predict_collisions(center, velocity, s1->get_radius(), 0.0, candidates,
+                       &candidate_times[k * n]);
+  }
+
+  for (int j = 0; j < n; j++) {
+    for (int k = 0; k < images; k++) {
+      long double collision_time = candidate_times[k * n + j];
+
+      if (collision_time >= 0 &&
+          current_time + collision_time < next_event.time) {
+        int other = candidates.index[j];
+        next_event = Event(current_time + collision_time, index_of(s1), other,
+                           s1->get_collision_count(),
+                           spheres[other].get_collision_count());
+      }
     }
   }
+
+  return next_event;
 }
 
-std::vector<point3> sphere_simulation::get_images(Sphere *s) {
-  point3 &center = s->get_center();
+std::vector<point3> sphere_simulation::get_images(const Sphere *s) const {
+  const point3 &center = s->get_center();
   point3 future_center =
       center + s->get_velocity() * (this->max_time - this->current_time);
   std::vector<point3> tarus_images = std::vector<point3>();
@@ -178,14 +298,27 @@ std::vector<point3> sphere_simulation::get_images(Sphere *s) {
   return tarus_images;
 }
 
-void sphere_simulation::wrap_around(Sphere *s) {
+void sphere_simulation::nearest_image(Sphere *s, Sphere *other) {
   point3 &center = s->get_center();
+  const point3 &other_center = other->get_center();
 
   for (int i = 0; i < DIMENSIONS; i++) {
-    if (center[i] >= this->torus_size) {
-      center[i] -= this->torus_size;
-    } else if (center[i] < 0) {
+    long double d = other_center[i] - center[i];
+    if (d > this->torus_size / 2) {
       center[i] += this->torus_size;
+    } else if (d < -this->torus_size / 2) {
+      center[i] -= this->torus_size;
+    }
+  }
+}
+
+void sphere_simulation::wrap_around(Sphere *s) {
+  point3 &center = s->get_center();
+
+  // lazily advanced spheres can be more than one torus length out
+  for (int i = 0; i < DIMENSIONS; i++) {
+    if (center[i] >= this->torus_size || center[i] < 0) {
+      center[i] -= this->torus_size * floorl(center[i] / this->torus_size);
     }
   }
 }
\ No newline at end of file
@@ -0,0 +1,100 @@
+#define CATCH_CONFIG_MAIN
+
+#include <random>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "CalendarQueue.h"
+#include "Event.h"
+#include "EventHeap.h"
+
+TEST_CASE("Calendar Queue Ordering") {
+  CalendarQueue queue(4);
+  REQUIRE(queue.empty());
+
+  queue.update(0, Event(0.4, 0, 1, 0, 0));
+  queue.update(1, Event(0.2, 1, 2, 0, 0));
+  queue.update(2, Event(3.5, 2, 3, 0, 0));
+
+  REQUIRE(queue.top_index() == 1);
+
+  queue.update(2, Event(0.1, 2, 3, 0, 0));
+  REQUIRE(queue.top_index() == 2);
+
+  queue.remove(2);
+  queue.remove(1);
+  REQUIRE(queue.top_index() == 0);
+
+  queue.remove(0);
+  REQUIRE(queue.empty());
+}
+
+TEST_CASE("Calendar Queue Matches Heap") {
+  const int n = 500;
+  CalendarQueue calendar(n);
+  EventHeap heap(n);
+
+  std::mt19937 gen(42);
+  std::uniform_real_distribution<long double> dt(0, 0.01);
+  std::uniform_int_distribution<int> sphere(0, n - 1);
+
+  for (int i = 0; i < n; i++) {
+    Event e(dt(gen) * 100, i, (i + 1) % n, 0, 0);
+    calendar.update(i, e);
+    heap.update(i, e);
+  }
+
+  // replay a simulation-like workload: the earliest event is handled and
+  // replaced along with a random partner, always in the future
+  int mismatches = 0;
+  for (int step = 0; step < 20000; step++) {
+    if (calendar.top_index() != heap.top_index()) {
+      mismatches++;
+    }
+
+    long double now = heap.top().time;
+    int i = heap.top_index();
+    int j = sphere(gen);
+
+    Event e1(now + dt(gen) * 100, i, j, 0, 0);
+    Event e2(now + dt(gen) * 100, j, i, 0, 0);
+    calendar.update(i, e1);
+    heap.update(i, e1);
+    calendar.update(j, e2);
+    heap.update(j, e2);
+  }
+
+  REQUIRE(mismatches == 0);
+
+  // the calendar grew to roughly the number of pending events
+  REQUIRE(calendar.get_bucket_count() >= n / 2);
+  REQUIRE(calendar.get_bucket_count() <= 2 * n);
+}
+
+TEST_CASE("Calendar Queue Assign") {
+  const int n = 500;
+  CalendarQueue calendar(n);
+  EventHeap heap(n);
+
+  std::mt19937 gen(7);
+  std::uniform_real_distribution<long double> time(0, 1);
+  std::vector<Event> events(n);
+  for (int i = 0; i < n; i += 2) {
+    events[i] = Event(time(gen), i, (i + 1) % n, 0, 0);
+  }
+  calendar.assign(events);
+  heap.assign(events);
+
+  // sized for the pending events in one go
+  REQUIRE(calendar.get_bucket_count() >= n / 4);
+  REQUIRE(calendar.get_bucket_count() <= n);
+
+  for (int k = 0; k < n / 2; k++) {
+    REQUIRE(calendar.top_index() == heap.top_index());
+    int i = heap.top_index();
+    calendar.remove(i);
+    heap.remove(i);
+  }
+  REQUIRE(calendar.empty());
+  REQUIRE(heap.empty());
+}
@@ -0,0 +1,88 @@
+#define CATCH_CONFIG_MAIN
+
+#include <random>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "CollisionKernel.h"
+#include "SphereStore.h"
+
+// compares every kernel the cpu supports against collide on random spheres
+template <typename Scalar> int kernel_mismatches(KernelType type) {
+  const int n = 37; // not a multiple of any vector width
+  std::mt19937 gen(7);
+  std::uniform_real_distribution<Scalar> uniform_dist(0, 1);
+  std::normal_distribution<Scalar> normal_dist(0, 1);
+
+  BasicSphereStore<Scalar> store(n, 0.1, 1.0);
+  for (int i = 0; i < n; i++) {
+    for (int d = 0; d < DIMENSIONS; d++) {
+      store.center(i, d) = uniform_dist(gen);
+      store.velocity(i, d) = normal_dist(gen);
+    }
+  }
+
+  CandidateBlock<Scalar> block;
+  for (int j = 1; j < n; j++) {
+    Scalar center[DIMENSIONS];
+    Scalar velocity[DIMENSIONS];
+    for (int d = 0; d < DIMENSIONS; d++) {
+      center[d] = store.center(j, d);
+      velocity[d] = store.velocity(j, d);
+    }
+    block.push_back(j, center, velocity, store.radius(j));
+  }
+
+  Scalar center[DIMENSIONS];
+  Scalar velocity[DIMENSIONS];
+  for (int d = 0; d < DIMENSIONS; d++) {
+    center[d] = store.center(0, d);
+    velocity[d] = store.velocity(0, d);
+  }
+
+  KernelType previous = get_kernel_type();
+  set_kernel_type(type);
+  std::vector<Scalar> times(block.size());
+  predict_collisions(center, velocity, store.radius(0), store.get_torus_size(),
+                     block, times.data());
+  set_kernel_type(previous);
+
+  int mismatches = 0;
+  for (int k = 0; k < block.size(); k++) {
+    if (times[k] != collide(store, 0, block.index[k])) {
+      mismatches++;
+    }
+  }
+  return mismatches;
+}
+
+TEST_CASE("Collision Kernel Selection", "[CollisionKernel]") {
+  REQUIRE(kernel_supported(KernelType::SCALAR));
+  REQUIRE(kernel_supported(get_kernel_type()));
+
+  KernelType previous = get_kernel_type();
+  set_kernel_type(KernelType::SCALAR);
+  REQUIRE(get_kernel_type() == KernelType::SCALAR);
+  set_kernel_type(previous);
+}
+
+TEST_CASE("Collision Kernel Matches Collide", "[CollisionKernel]") {
+  for (KernelType type :
+       {KernelType::SCALAR, KernelType::AVX2, KernelType::AVX512}) {
+    if (!kernel_supported(type)) {
+      continue;
+    }
+    REQUIRE(kernel_mismatches<float>(type) == 0);
+    REQUIRE(kernel_mismatches<double>(type) == 0);
+  }
+  REQUIRE(kernel_mismatches<long double>(KernelType::SCALAR) == 0);
+}
+
+TEST_CASE("Collision Kernel Empty Block", "[CollisionKernel]") {
+  CandidateBlock<double> block;
+  double center[DIMENSIONS] = {};
+  double velocity[DIMENSIONS] = {};
+  predict_collisions(center, velocity, 0.1, 1.0, block, (double *)nullptr);
+  REQUIRE(block.size() == 0);
+}
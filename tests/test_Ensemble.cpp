@@ -0,0 +1,48 @@
+#define CATCH_CONFIG_MAIN
+
+#include <algorithm>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "Ensemble.h"
+
+TEST_CASE("Ensemble Threads") {
+  // replicas come out the same however many threads run them
+  Ensemble serial(300, 6, 42);
+  serial.set_thread_count(1);
+  serial.run();
+
+  Ensemble threaded(300, 6, 42);
+  threaded.set_thread_count(4);
+  threaded.run();
+
+  size_t total = 0;
+  for (int r = 0; r < serial.get_replica_count(); r++) {
+    REQUIRE(!serial.get_collision_times(r).empty());
+    REQUIRE(threaded.get_collision_times(r) == serial.get_collision_times(r));
+    REQUIRE(threaded.get_stale_event_count(r) ==
+            serial.get_stale_event_count(r));
+    total += serial.get_collision_times(r).size();
+  }
+  REQUIRE(serial.get_collision_times(0) != serial.get_collision_times(1));
+
+  std::vector<long double> merged = threaded.get_merged_collision_times();
+  REQUIRE(merged.size() == total);
+  REQUIRE(std::is_sorted(merged.begin(), merged.end()));
+}
+
+TEST_CASE("Ensemble Seeds") {
+  // a replica is the same run as a simulation reset to its seed
+  Ensemble ensemble(300, 3, 5);
+  ensemble.run();
+
+  EventDrivenSimulation sim(QueueType::HEAP);
+  sim.reset(300, Ensemble::get_replica_seed(5, 2));
+  sim.initialize_events();
+  sim.run_simulation();
+  REQUIRE(sim.get_collision_times() == ensemble.get_collision_times(2));
+
+  REQUIRE(Ensemble::get_replica_seed(5, 0) != Ensemble::get_replica_seed(5, 1));
+  REQUIRE(Ensemble::get_replica_seed(5, 1) != Ensemble::get_replica_seed(6, 0));
+}
@@ -0,0 +1,403 @@
+#define CATCH_CONFIG_MAIN
+
+#include <random>
+#include <sstream>
+#include <utility>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "EventDrivenSimulation.h"
+#include "Sphere.h"
+
+namespace {
+
+// n random spheres drawn from seed, twice, so two simulations can each take
+// ownership of one copy
+std::pair<Sphere *, Sphere *> random_spheres(unsigned seed, int n,
+                                             long double radius) {
+  std::mt19937 gen(seed);
+  std::uniform_real_distribution<long double> uniform_dist(0, 1);
+  std::normal_distribution<long double> normal_dist(0, 1);
+  Sphere *spheres = new Sphere[n];
+  Sphere *copies = new Sphere[n];
+  for (int i = 0; i < n; i++) {
+    point3 center;
+    vec3 velocity;
+    for (int j = 0; j < 3; j++) {
+      center[j] = uniform_dist(gen);
+      velocity[j] = normal_dist(gen);
+    }
+    velocity.normalize();
+    spheres[i] = Sphere(radius, center, velocity);
+    copies[i] = spheres[i];
+  }
+  return {spheres, copies};
+}
+
+// other handled the same events as sim and left its n spheres the same
+void expect_same_run(EventDrivenSimulation &sim, EventDrivenSimulation &other,
+                     int n) {
+  REQUIRE(sim.get_collision_times().size() > 0);
+  REQUIRE(other.get_collision_times() == sim.get_collision_times());
+  REQUIRE(other.get_stale_event_count() == sim.get_stale_event_count());
+  REQUIRE(other.get_event_count() == sim.get_event_count());
+  for (int i = 0; i < n; i++) {
+    REQUIRE(other.get_sphere(i) == sim.get_sphere(i));
+    REQUIRE(other.get_sphere(i).get_center() == sim.get_sphere(i).get_center());
+  }
+}
+
+} // namespace
+
+TEST_CASE("Event Driven Sim Constructor") {
+  EventDrivenSimulation sim(1000);
+}
+
+TEST_CASE("Event Driven Sim Collision Detection") {
+  Sphere *spheres = new Sphere[2];
+  spheres[0] = Sphere(0.05, point3(0.35, 0.5, 0.5), vec3(1, 0, 0));
+  spheres[1] = Sphere(0.05, point3(0.48, 0.5, 0.5), vec3(-1, 0, 0));
+
+  EventDrivenSimulation sim(2, spheres);
+  sim.initialize_events();
+  sim.run_simulation();
+
+  REQUIRE(sim.get_collision_times().size() == 1);
+  REQUIRE(std::abs(sim.get_collision_times()[0] - 0.015) < 1e-9);
+
+  REQUIRE(sim.get_sphere(0).get_time() == MAX_SIMULATION_TIME);
+  REQUIRE(sim.get_sphere(1).get_time() == MAX_SIMULATION_TIME);
+  REQUIRE(sim.get_sphere(0).get_center().isApprox(point3(0.38, 0.5, 0.5)));
+  REQUIRE(sim.get_sphere(1).get_center().isApprox(point3(0.45, 0.5, 0.5)));
+}
+
+TEST_CASE("Event Driven Sim Lazy Clocks") {
+  Sphere *spheres = new Sphere[3];
+  spheres[0] = Sphere(0.05, point3(0.35, 0.5, 0.5), vec3(1, 0, 0));
+  spheres[1] = Sphere(0.05, point3(0.48, 0.5, 0.5), vec3(-1, 0, 0));
+  // far away from the colliding pair
+  spheres[2] = Sphere(0.05, point3(0.8, 0.1, 0.1), vec3(0, 1, 0));
+
+  EventDrivenSimulation sim(3, spheres);
+  sim.initialize_events();
+  sim.run_simulation_step();
+
+  // only the participants were moved to the event time
+  REQUIRE(std::abs(sim.get_sphere(0).get_time() - 0.015) < 1e-9);
+  REQUIRE(std::abs(sim.get_sphere(1).get_time() - 0.015) < 1e-9);
+  REQUIRE(sim.get_sphere(2).get_time() == 0);
+  REQUIRE(sim.get_sphere(2).get_center().isApprox(point3(0.8, 0.1, 0.1)));
+
+  sim.run_simulation();
+
+  REQUIRE(sim.get_collision_times().size() == 1);
+  REQUIRE(sim.get_sphere(2).get_time() == MAX_SIMULATION_TIME);
+  REQUIRE(sim.get_sphere(2).get_center().isApprox(point3(0.8, 0.1, 0.1)));
+}
+
+TEST_CASE("Event Driven Sim Calendar Queue") {
+  Sphere *spheres = new Sphere[2];
+  spheres[0] = Sphere(0.05, point3(0.35, 0.5, 0.5), vec3(1, 0, 0));
+  spheres[1] = Sphere(0.05, point3(0.48, 0.5, 0.5), vec3(-1, 0, 0));
+
+  EventDrivenSimulation sim(2, spheres, QueueType::CALENDAR);
+  sim.initialize_events();
+  sim.run_simulation();
+
+  REQUIRE(sim.get_collision_times().size() == 1);
+  REQUIRE(std::abs(sim.get_collision_times()[0] - 0.015) < 1e-9);
+}
+
+TEST_CASE("Event Driven Sim Multi Queue") {
+  Sphere *spheres = new Sphere[2];
+  spheres[0] = Sphere(0.05, point3(0.35, 0.5, 0.5), vec3(1, 0, 0));
+  spheres[1] = Sphere(0.05, point3(0.48, 0.5, 0.5), vec3(-1, 0, 0));
+
+  EventDrivenSimulation sim(2, spheres, QueueType::MULTI);
+  sim.initialize_events();
+  sim.run_simulation();
+
+  REQUIRE(sim.get_collision_times().size() == 1);
+  REQUIRE(std::abs(sim.get_collision_times()[0] - 0.015) < 1e-9);
+}
+
+TEST_CASE("Event Driven Sim Reset") {
+  // a reused simulation runs the same as a fresh one with the same seed
+  QueueType types[] = {QueueType::HEAP, QueueType::CALENDAR, QueueType::MULTI};
+  for (QueueType type : types) {
+    EventDrivenSimulation fresh(type);
+    fresh.reset(300, 7);
+    fresh.initialize_events();
+    fresh.run_simulation();
+
+    EventDrivenSimulation reused(type);
+    reused.reset(1000, 8);
+    reused.initialize_events();
+    reused.run_simulation();
+    reused.reset(300, 7);
+    reused.initialize_events();
+    reused.run_simulation();
+
+    REQUIRE(!fresh.get_collision_times().empty());
+    REQUIRE(reused.get_collision_times() == fresh.get_collision_times());
+    REQUIRE(reused.get_stale_event_count() == fresh.get_stale_event_count());
+    REQUIRE(reused.get_spheres().size() == fresh.get_spheres().size());
+    for (int i = 0; i < fresh.get_spheres().size(); i++) {
+      REQUIRE(reused.get_sphere(i).get_center() ==
+              fresh.get_sphere(i).get_center());
+    }
+  }
+}
+
+TEST_CASE("Event Driven Sim Seeded Threads") {
+  // a seed gives the same run whatever the thread count
+  EventDrivenSimulation serial(QueueType::HEAP);
+  serial.set_thread_count(1);
+  serial.reset(500, 12);
+  serial.initialize_events();
+  serial.run_simulation();
+
+  EventDrivenSimulation threaded(QueueType::HEAP);
+  threaded.set_thread_count(4);
+  threaded.reset(500, 12);
+  threaded.initialize_events();
+  threaded.run_simulation();
+
+  REQUIRE(!serial.get_collision_times().empty());
+  REQUIRE(threaded.get_collision_times() == serial.get_collision_times());
+  for (int i = 0; i < serial.get_spheres().size(); i++) {
+    REQUIRE(threaded.get_sphere(i).get_center() ==
+            serial.get_sphere(i).get_center());
+  }
+}
+
+TEST_CASE("Event Driven Sim Stats") {
+  EventDrivenSimulation sim(QueueType::HEAP);
+  sim.set_thread_count(1);
+  sim.reset(500, 12);
+  sim.initialize_events();
+  std::ostringstream out;
+  sim.set_stats_output(&out);
+  sim.run_simulation();
+
+  SimulationStats stats = sim.get_stats();
+  REQUIRE(stats.events == sim.get_event_count());
+  REQUIRE(stats.stale_events == sim.get_stale_event_count());
+  REQUIRE(out.str().find("\"collide_calls\": ") != std::string::npos);
+
+#if COLLECT_STATS
+  REQUIRE(stats.collide_calls > 0);
+  REQUIRE(stats.candidate_pairs >= stats.collide_calls);
+  REQUIRE(stats.cell_migrations > 0);
+  REQUIRE(stats.cells_visited > 0);
+  REQUIRE(stats.peak_queue_size >= stats.pending_events);
+  REQUIRE(stats.peak_queue_size <= sim.get_spheres().size());
+
+  // the first predictions do not depend on the thread count
+  EventDrivenSimulation threaded(QueueType::HEAP);
+  threaded.set_thread_count(4);
+  threaded.reset(500, 12);
+  threaded.initialize_events();
+  EventDrivenSimulation serial(QueueType::HEAP);
+  serial.set_thread_count(1);
+  serial.reset(500, 12);
+  serial.initialize_events();
+  REQUIRE(threaded.get_stats().collide_calls ==
+          serial.get_stats().collide_calls);
+  REQUIRE(threaded.get_stats().pending_events ==
+          serial.get_stats().pending_events);
+#else
+  REQUIRE(stats.collide_calls == 0);
+  REQUIRE(stats.peak_queue_size == 0);
+#endif
+}
+
+TEST_CASE("Event Driven Sim Cell Transfer") {
+  // the spheres start two cells apart on opposite sides of the boundary and
+  // only find each other once the first one has moved into cell 0
+  Sphere *spheres = new Sphere[2];
+  spheres[0] = Sphere(0.05, point3(0.97, 0.5, 0.5), vec3(1, 0, 0));
+  spheres[1] = Sphere(0.05, point3(0.12, 0.5, 0.5), vec3(0, 0, 0));
+
+  EventDrivenSimulation sim(2, spheres);
+  sim.initialize_events();
+  sim.run_simulation();
+
+  REQUIRE(sim.get_collision_times().size() == 1);
+  REQUIRE(std::abs(sim.get_collision_times()[0] - 0.05) < 1e-9);
+
+  REQUIRE(sim.get_sphere(0).get_center().isApprox(point3(0.02, 0.5, 0.5)));
+  REQUIRE(sim.get_sphere(1).get_center().isApprox(point3(0.07, 0.5, 0.5)));
+  REQUIRE(sim.get_sphere(0).get_velocity().isApprox(vec3(0, 0, 0)));
+  REQUIRE(sim.get_sphere(1).get_velocity().isApprox(vec3(1, 0, 0)));
+}
+
+TEST_CASE("Event Driven Sim Double Precision") {
+  Sphere *spheres = new Sphere[2];
+  spheres[0] = Sphere(0.05, point3(0.97, 0.5, 0.5), vec3(1, 0, 0));
+  spheres[1] = Sphere(0.05, point3(0.12, 0.5, 0.5), vec3(0, 0, 0));
+
+  BasicEventDrivenSimulation<double> sim(2, spheres);
+  sim.initialize_events();
+  sim.run_simulation();
+
+  REQUIRE(sim.get_collision_times().size() == 1);
+  REQUIRE(std::abs(sim.get_collision_times()[0] - 0.05) < 1e-9);
+  REQUIRE(sim.get_sphere(1).get_center().isApprox(point3(0.07, 0.5, 0.5)));
+}
+
+TEST_CASE("Event Driven Sim Single Precision") {
+  Sphere *spheres = new Sphere[2];
+  spheres[0] = Sphere(0.05, point3(0.35, 0.5, 0.5), vec3(1, 0, 0));
+  spheres[1] = Sphere(0.05, point3(0.48, 0.5, 0.5), vec3(-1, 0, 0));
+
+  BasicEventDrivenSimulation<float> sim(2, spheres);
+  sim.initialize_events();
+  sim.run_simulation();
+
+  REQUIRE(sim.get_collision_times().size() == 1);
+  REQUIRE(std::abs(sim.get_collision_times()[0] - 0.015) < 1e-6);
+  REQUIRE(sim.get_sphere(0).get_center().isApprox(point3(0.38, 0.5, 0.5),
+                                                  1e-5));
+}
+
+TEST_CASE("Event Driven Sim Other Dimensions") {
+  // head on collisions in 2 and 4 dimensions from the same binary
+  BasicSphere<2> *spheres2 = new BasicSphere<2>[2];
+  spheres2[0] = BasicSphere<2>(0.05, {0.35, 0.5}, {1, 0});
+  spheres2[1] = BasicSphere<2>(0.05, {0.48, 0.5}, {-1, 0});
+
+  BasicEventDrivenSimulation<double, 2> sim2(2, spheres2);
+  sim2.initialize_events();
+  sim2.run_simulation();
+
+  REQUIRE(sim2.get_collision_times().size() == 1);
+  REQUIRE(std::abs(sim2.get_collision_times()[0] - 0.015) < 1e-9);
+  REQUIRE(sim2.get_sphere(0).get_center().isApprox(
+      BasicSphere<2>::point(0.38, 0.5)));
+
+  BasicSphere<4> *spheres4 = new BasicSphere<4>[2];
+  spheres4[0] = BasicSphere<4>(0.05, {0.5, 0.5, 0.5, 0.97}, {0, 0, 0, 1});
+  spheres4[1] = BasicSphere<4>(0.05, {0.5, 0.5, 0.5, 0.12}, {0, 0, 0, 0});
+
+  BasicEventDrivenSimulation<double, 4> sim4(2, spheres4);
+  sim4.initialize_events();
+  sim4.run_simulation();
+
+  REQUIRE(sim4.get_collision_times().size() == 1);
+  REQUIRE(std::abs(sim4.get_collision_times()[0] - 0.05) < 1e-9);
+  REQUIRE(sim4.get_sphere(1).get_center().isApprox(
+      BasicSphere<4>::point(0.5, 0.5, 0.5, 0.07)));
+}
+
+TEST_CASE("Event Driven Sim Random Dimensions") {
+  BasicEventDrivenSimulation<double, 2> sim2(200);
+  sim2.initialize_events();
+  sim2.run_simulation();
+  REQUIRE(sim2.get_current_time() == MAX_SIMULATION_TIME);
+
+  BasicEventDrivenSimulation<double, 4> sim4(200);
+  sim4.initialize_events();
+  sim4.run_simulation();
+  REQUIRE(sim4.get_current_time() == MAX_SIMULATION_TIME);
+}
+
+TEST_CASE("Event Driven Sim Reorder") {
+  // the same spheres with and without reordering after every event
+  std::pair<Sphere *, Sphere *> spheres = random_spheres(1, 300, 0.02);
+
+  EventDrivenSimulation sim(300, spheres.first);
+  sim.set_reorder_interval(0);
+  sim.initialize_events();
+  sim.run_simulation();
+
+  EventDrivenSimulation reordered(300, spheres.second);
+  reordered.set_reorder_interval(1);
+  reordered.initialize_events();
+  reordered.run_simulation();
+
+  expect_same_run(sim, reordered, 300);
+}
+
+TEST_CASE("Event Driven Sim Threads") {
+  // the initial events do not depend on how many threads predict them
+  std::pair<Sphere *, Sphere *> spheres = random_spheres(2, 300, 0.02);
+
+  EventDrivenSimulation sim(300, spheres.first);
+  sim.set_thread_count(1);
+  sim.initialize_events();
+  sim.run_simulation();
+
+  EventDrivenSimulation threaded(300, spheres.second);
+  threaded.set_thread_count(4);
+  threaded.initialize_events();
+  threaded.run_simulation();
+
+  expect_same_run(sim, threaded, 300);
+}
+
+TEST_CASE("Event Driven Sim Sectors") {
+  // sectors run in parallel, but every event is handled as it would be in
+  // the serial run
+  std::pair<Sphere *, Sphere *> spheres = random_spheres(3, 1000, 0.01);
+
+  EventDrivenSimulation sim(1000, spheres.first);
+  sim.set_reorder_interval(0);
+  sim.initialize_events();
+  sim.run_simulation();
+
+  EventDrivenSimulation sectors(1000, spheres.second);
+  sectors.set_reorder_interval(0);
+  sectors.set_sector_count(4);
+  sectors.initialize_events();
+  sectors.run_simulation();
+
+  expect_same_run(sim, sectors, 1000);
+  // sectors only run up to where their neighbours have got, so little of
+  // what they did is taken back
+  REQUIRE(sectors.get_rolled_back_count() < sectors.get_event_count() / 10);
+}
+
+TEST_CASE("Event Driven Sim Time Warp") {
+  // sectors run ahead of each other and are taken back when a border event
+  // reaches them, and still every event is kept as in the serial run
+  std::pair<Sphere *, Sphere *> spheres = random_spheres(4, 1000, 0.01);
+
+  EventDrivenSimulation sim(1000, spheres.first);
+  sim.set_reorder_interval(0);
+  sim.initialize_events();
+  sim.run_simulation();
+
+  EventDrivenSimulation warped(1000, spheres.second);
+  warped.set_reorder_interval(0);
+  warped.set_sector_count(6);
+  warped.set_sector_scheduling(SectorScheduling::TIME_WARP);
+  warped.initialize_events();
+  warped.run_simulation();
+
+  expect_same_run(sim, warped, 1000);
+  // sectors did run ahead of their neighbours and were taken back
+  REQUIRE(warped.get_rolled_back_count() > 0);
+  REQUIRE(sim.get_rolled_back_count() == 0);
+}
+
+TEST_CASE("Event Driven Sim Multi Queue Sectors") {
+  // threads pick sectors from a relaxed queue, and events are only handled
+  // once nothing they depend on is pending, so the run matches the serial one
+  std::pair<Sphere *, Sphere *> spheres = random_spheres(5, 1000, 0.01);
+
+  EventDrivenSimulation sim(1000, spheres.first);
+  sim.set_reorder_interval(0);
+  sim.initialize_events();
+  sim.run_simulation();
+
+  EventDrivenSimulation relaxed(1000, spheres.second);
+  relaxed.set_reorder_interval(0);
+  relaxed.set_sector_count(8);
+  relaxed.set_thread_count(4);
+  relaxed.set_sector_scheduling(SectorScheduling::MULTI_QUEUE);
+  relaxed.initialize_events();
+  relaxed.run_simulation();
+
+  expect_same_run(sim, relaxed, 1000);
+}
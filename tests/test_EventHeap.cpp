@@ -0,0 +1,66 @@
+#define CATCH_CONFIG_MAIN
+
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "Event.h"
+#include "EventHeap.h"
+
+TEST_CASE("Event Heap Empty") {
+  EventHeap heap(4);
+  REQUIRE(heap.size() == 4);
+  REQUIRE(heap.empty());
+}
+
+TEST_CASE("Event Heap Ordering") {
+  EventHeap heap(4);
+
+  heap.update(0, Event(0.4, 0, 1, 0, 0));
+  heap.update(1, Event(0.2, 1, 2, 0, 0));
+  heap.update(2, Event(0.3, 2, 3, 0, 0));
+
+  REQUIRE(!heap.empty());
+  REQUIRE(heap.top_index() == 1);
+  REQUIRE(heap.top().time == 0.2);
+
+  // decrease-key
+  heap.update(2, Event(0.1, 2, 3, 0, 0));
+  REQUIRE(heap.top_index() == 2);
+
+  // increase-key
+  heap.update(2, Event(0.5, 2, 3, 0, 0));
+  REQUIRE(heap.top_index() == 1);
+
+  heap.remove(1);
+  REQUIRE(heap.top_index() == 0);
+  heap.remove(0);
+  REQUIRE(heap.top_index() == 2);
+  heap.remove(2);
+  REQUIRE(heap.empty());
+
+  // one slot per sphere, no matter how often it is updated
+  REQUIRE(heap.size() == 4);
+}
+
+TEST_CASE("Event Heap Assign") {
+  EventHeap heap(2);
+  heap.update(0, Event(0.1, 0, 1, 0, 0));
+
+  // replaces every slot, and can change the number of them
+  std::vector<Event> events(6);
+  events[0] = Event(0.6, 0, 1, 0, 0);
+  events[2] = Event(0.3, 2, 3, 0, 0);
+  events[3] = Event(0.5, 3, 4, 0, 0);
+  events[5] = Event(0.2, 5, 0, 0, 0);
+  heap.assign(events);
+  REQUIRE(heap.size() == 6);
+  REQUIRE(heap.get(0).time == 0.6);
+
+  int order[] = {5, 2, 3, 0};
+  for (int i : order) {
+    REQUIRE(heap.top_index() == i);
+    heap.remove(i);
+  }
+  REQUIRE(heap.empty());
+}
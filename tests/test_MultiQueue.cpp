@@ -0,0 +1,57 @@
+#define CATCH_CONFIG_MAIN
+
+#include <limits>
+#include <random>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "Event.h"
+#include "MultiQueue.h"
+
+TEST_CASE("Multi Queue Ordering") {
+  // used from one thread it is an exact queue
+  MultiQueue queue(6, 3);
+  REQUIRE(queue.empty());
+
+  queue.update(0, Event(0.4, 0, 1, 0, 0));
+  queue.update(1, Event(0.2, 1, 2, 0, 0));
+  queue.update(4, Event(0.3, 4, 3, 0, 0));
+  queue.update(5, Event(0.1, 5, 3, 0, 0));
+  REQUIRE(queue.top_index() == 5);
+  REQUIRE(queue.peek(queue.get_partition(5)) == 0.1);
+
+  int order[] = {5, 1, 4, 0};
+  for (int i : order) {
+    REQUIRE(queue.top_index() == i);
+    queue.remove(i);
+  }
+  REQUIRE(queue.empty());
+}
+
+TEST_CASE("Multi Queue Two Choices") {
+  MultiQueue queue(4, 2);
+  std::vector<Event> events(4);
+  events[0] = Event(0.5, 0, 1, 0, 0);
+  events[3] = Event(0.2, 3, 2, 0, 0);
+  queue.assign(events, {0, 0, 1, 1});
+  REQUIRE(queue.peek(0) == 0.5);
+  REQUIRE(queue.peek(1) == 0.2);
+
+  // with two partitions both are always sampled
+  std::mt19937 gen(1);
+  for (int k = 0; k < 10; k++) {
+    REQUIRE(queue.choose(gen) == 1);
+  }
+
+  // tops are published as slots move and change
+  queue.move(0, 1);
+  REQUIRE(queue.peek(0) == std::numeric_limits<double>::infinity());
+  queue.update(3, Event(0.7, 3, 2, 0, 0));
+  REQUIRE(queue.peek(1) == 0.5);
+  REQUIRE(queue.choose(gen) == 1);
+
+  REQUIRE(queue.try_lock(0));
+  REQUIRE(!queue.try_lock(0));
+  queue.unlock(0);
+}
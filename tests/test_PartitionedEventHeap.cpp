@@ -0,0 +1,55 @@
+#define CATCH_CONFIG_MAIN
+
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "Event.h"
+#include "PartitionedEventHeap.h"
+
+TEST_CASE("Partitioned Event Heap Ordering") {
+  PartitionedEventHeap heap(6, 2);
+  REQUIRE(heap.size() == 6);
+  REQUIRE(heap.empty());
+
+  std::vector<Event> events(6);
+  events[0] = Event(0.6, 0, 1, 0, 0);
+  events[1] = Event(0.1, 1, 0, 0, 0);
+  events[2] = Event(0.3, 2, 3, 0, 0);
+  events[3] = Event(0.5, 3, 4, 0, 0);
+  events[5] = Event(0.2, 5, 0, 0, 0);
+  heap.assign(events, {0, 0, 0, 1, 1, 1});
+
+  EventQueue &first = heap.partition(0);
+  EventQueue &second = heap.partition(1);
+  REQUIRE(first.size() == 3);
+  REQUIRE(second.size() == 3);
+  REQUIRE(first.top_index() == 1);
+  REQUIRE(second.top_index() == 5);
+  REQUIRE(heap.top_index() == 1);
+
+  // updates stay in the partition of the slot
+  first.update(1, Event(0.7, 1, 0, 0, 0));
+  REQUIRE(first.top_index() == 2);
+  REQUIRE(heap.top_index() == 5);
+  second.remove(5);
+  REQUIRE(second.top_index() == 3);
+  REQUIRE(heap.top_index() == 2);
+
+  // moving a slot keeps its event
+  heap.move(2, 1);
+  REQUIRE(heap.get_partition(2) == 1);
+  REQUIRE(first.size() == 2);
+  REQUIRE(second.size() == 4);
+  REQUIRE(first.top_index() == 0);
+  REQUIRE(second.top_index() == 2);
+
+  int order[] = {2, 3, 0, 1};
+  for (int i : order) {
+    REQUIRE(heap.top_index() == i);
+    heap.remove(i);
+  }
+  REQUIRE(heap.empty());
+  REQUIRE(first.empty());
+  REQUIRE(second.empty());
+}
@@ -0,0 +1,72 @@
+#define CATCH_CONFIG_MAIN
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "Philox.h"
+#include "vec3.h"
+
+TEST_CASE("Philox Known Answers") {
+  // from the known answer tests of Random123
+  std::array<std::uint32_t, 4> zero =
+      philox4x32({0, 0, 0, 0}, {0, 0});
+  REQUIRE(zero == std::array<std::uint32_t, 4>{0x6627e8d5, 0xe169c58d,
+                                               0xbc57ac4c, 0x9b00dbd8});
+
+  std::array<std::uint32_t, 4> ones =
+      philox4x32({0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff},
+                 {0xffffffff, 0xffffffff});
+  REQUIRE(ones == std::array<std::uint32_t, 4>{0x408f276d, 0x41c83b0e,
+                                               0xa20bc7c6, 0x6d5451fd});
+
+  std::array<std::uint32_t, 4> pi =
+      philox4x32({0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344},
+                 {0xa4093822, 0x299f31d0});
+  REQUIRE(pi == std::array<std::uint32_t, 4>{0xd16cfe09, 0x94fdcceb,
+                                             0x5001e420, 0x24126ea1});
+}
+
+TEST_CASE("Philox Streams") {
+  // a stream only depends on its seed and index
+  PhiloxStream a(7, 3), b(7, 3), other_index(7, 4), other_seed(8, 3);
+  bool differ_index = false, differ_seed = false;
+  for (int i = 0; i < 10; i++) {
+    std::uint64_t x = a();
+    REQUIRE(x == b());
+    differ_index |= x != other_index();
+    differ_seed |= x != other_seed();
+  }
+  REQUIRE(differ_index);
+  REQUIRE(differ_seed);
+
+  PhiloxStream stream(1, 0);
+  double sum = 0, squares = 0;
+  for (int i = 0; i < 10000; i++) {
+    double u = stream.uniform();
+    REQUIRE(u >= 0);
+    REQUIRE(u < 1);
+    double z = stream.normal();
+    sum += z;
+    squares += z * z;
+  }
+  REQUIRE(std::abs(sum / 10000) < 0.05);
+  REQUIRE(std::abs(squares / 10000 - 1) < 0.05);
+}
+
+TEST_CASE("Philox Draw Sphere") {
+  basic_point3<double, 3> center, again;
+  basic_vec3<double, 3> velocity, velocity_again;
+  draw_sphere<double, 3>(11, 5, center, velocity);
+  draw_sphere<double, 3>(11, 5, again, velocity_again);
+
+  REQUIRE(center == again);
+  REQUIRE(velocity == velocity_again);
+  REQUIRE(std::abs(velocity.norm() - 1) < 1e-12);
+  for (int j = 0; j < 3; j++) {
+    REQUIRE(center[j] >= 0);
+    REQUIRE(center[j] < 1);
+  }
+}
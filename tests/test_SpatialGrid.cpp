@@ -1,5 +1,9 @@
 #define CATCH_CONFIG_MAIN
 
+#include <algorithm>
+#include <cmath>
+#include <set>
+
 #include <catch2/catch_test_macros.hpp>
 
 #include "SpatialGrid.h"
@@ -10,4 +14,199 @@ TEST_CASE("Spatial Grid Constructor") {
 
 TEST_CASE("Spatial Grid Add Sphere") {
   SpatialGrid grid(0.1, 10, 10, 0.05);
-}
\ No newline at end of file
+}
+
+TEST_CASE("Spatial Grid Seeded") {
+  // spheres come out the same however many threads draw them
+  SpatialGrid serial(0.1, 10, 500, 0.01, 3, 1);
+  SpatialGrid threaded(0.1, 10, 500, 0.01, 3, 4);
+  SpatialGrid other(0.1, 10, 500, 0.01, 4, 1);
+
+  const SphereStore &spheres = serial.get_spheres();
+  bool differ = false;
+  for (int i = 0; i < spheres.size(); i++) {
+    REQUIRE(threaded.get_spheres().get_center(i) == spheres.get_center(i));
+    REQUIRE(threaded.get_spheres().get_velocity(i) ==
+            spheres.get_velocity(i));
+    REQUIRE(threaded.get_nearby_spheres(i) == serial.get_nearby_spheres(i));
+    differ |= other.get_spheres().get_center(i) != spheres.get_center(i);
+  }
+  REQUIRE(differ);
+}
+
+TEST_CASE("Spatial Grid Transfer") {
+  Sphere *spheres = new Sphere[2];
+  spheres[0] = Sphere(0.05, point3(0.97, 0.55, 0.55), vec3(1, 0, 0));
+  spheres[1] = Sphere(0.05, point3(0.15, 0.55, 0.55), vec3(0, 0, 0));
+  SpatialGrid grid(0.1, 10, 2, spheres);
+
+  REQUIRE(std::abs(grid.time_to_transfer(0) - 0.03) < 1e-12);
+  REQUIRE(std::isinf(grid.time_to_transfer(1)));
+
+  // wraps around into cell 0, which brings cell 1 into the neighbourhood
+  grid.advance_sphere(0, 0.03);
+  std::vector<int> new_neighbors = grid.transfer_sphere(0);
+  REQUIRE(new_neighbors.size() == 1);
+  REQUIRE(new_neighbors[0] == 1);
+
+  REQUIRE(std::abs(grid.time_to_transfer(0) - 0.1) < 1e-12);
+}
+
+TEST_CASE("Spatial Grid Nearby Spheres") {
+  Sphere *spheres = new Sphere[3];
+  spheres[0] = Sphere(0.05, point3(0.55, 0.55, 0.55), vec3(0, 0, 0));
+  spheres[1] = Sphere(0.05, point3(0.65, 0.45, 0.55), vec3(0, 0, 0));
+  spheres[2] = Sphere(0.05, point3(0.85, 0.55, 0.55), vec3(0, 0, 0));
+  SpatialGrid grid(0.1, 10, 3, spheres);
+
+  // visits the same spheres get_nearby_spheres collects
+  std::vector<int> visited;
+  grid.for_each_nearby_sphere(0, [&](int other) { visited.push_back(other); });
+  REQUIRE(visited == grid.get_nearby_spheres(0));
+
+  // every sphere once, sphere 2 is two cells away
+  REQUIRE(visited.size() == 2);
+  REQUIRE(std::count(visited.begin(), visited.end(), 0) == 1);
+  REQUIRE(std::count(visited.begin(), visited.end(), 1) == 1);
+  REQUIRE(std::count(visited.begin(), visited.end(), 2) == 0);
+
+  CandidateBlock<long double> block;
+  grid.get_nearby_candidates(0, block);
+  REQUIRE(block.size() == 1);
+  REQUIRE(block.index[0] == 1);
+}
+
+TEST_CASE("Spatial Grid Forward Pairs") {
+  SpatialGrid grid(0.1, 10, 200, 0.05);
+
+  // the full neighbourhoods give every pair from both sides
+  std::set<std::pair<int, int>> pairs;
+  for (int i = 0; i < 200; i++) {
+    grid.for_each_nearby_sphere(i, [&](int j) {
+      if (i != j) {
+        pairs.insert({std::min(i, j), std::max(i, j)});
+      }
+    });
+  }
+
+  // the forward halves give every pair exactly once
+  std::vector<std::pair<int, int>> forward_pairs;
+  for (int i = 0; i < 200; i++) {
+    grid.for_each_forward_sphere(i, [&](int j) {
+      forward_pairs.push_back({std::min(i, j), std::max(i, j)});
+    });
+  }
+  REQUIRE(forward_pairs.size() == pairs.size());
+  REQUIRE(std::set<std::pair<int, int>>(forward_pairs.begin(),
+                                        forward_pairs.end()) == pairs);
+}
+
+TEST_CASE("Spatial Grid Cell Lists") {
+  Sphere *spheres = new Sphere[3];
+  spheres[0] = Sphere(0.01, point3(0.52, 0.55, 0.55), vec3(0, 0, 0));
+  spheres[1] = Sphere(0.01, point3(0.55, 0.55, 0.55), vec3(1, 0, 0));
+  spheres[2] = Sphere(0.01, point3(0.58, 0.55, 0.55), vec3(0, 0, 0));
+  SpatialGrid grid(0.1, 10, 3, spheres);
+  REQUIRE(grid.get_occupied_cell_count() == 1);
+
+  // unlinking sphere 1 from the middle of the list keeps the others
+  grid.advance_sphere(1, grid.time_to_transfer(1));
+  grid.transfer_sphere(1);
+  REQUIRE(grid.get_occupied_cell_count() == 2);
+  std::vector<int> nearby = grid.get_nearby_spheres(0);
+  std::sort(nearby.begin(), nearby.end());
+  REQUIRE(nearby == std::vector<int>{0, 1, 2});
+
+  // two cells away, and its old cell is no longer stored once empty
+  grid.advance_sphere(1, grid.get_spheres().time(1) + grid.time_to_transfer(1));
+  grid.transfer_sphere(1);
+  nearby = grid.get_nearby_spheres(0);
+  std::sort(nearby.begin(), nearby.end());
+  REQUIRE(nearby == std::vector<int>{0, 2});
+  REQUIRE(grid.get_occupied_cell_count() == 2);
+  REQUIRE(grid.get_nearby_spheres(1) == std::vector<int>{1});
+}
+
+TEST_CASE("Spatial Grid Reorder") {
+  Sphere *spheres = new Sphere[3];
+  spheres[0] = Sphere(0.01, point3(0.95, 0.95, 0.95), vec3(0, 0, 0));
+  spheres[1] = Sphere(0.01, point3(0.05, 0.05, 0.05), vec3(1, 0, 0));
+  spheres[2] = Sphere(0.01, point3(0.15, 0.05, 0.05), vec3(0, 1, 0));
+  SpatialGrid grid(0.1, 10, 3, spheres);
+
+  // cell (0, 0, 0) comes first on the curve and cell (9, 9, 9) last
+  std::vector<int> order = grid.reorder();
+  REQUIRE(order == std::vector<int>{1, 2, 0});
+  REQUIRE(grid.get_index(0) == 2);
+  REQUIRE(grid.get_index(1) == 0);
+  REQUIRE(grid.get_index(2) == 1);
+  REQUIRE(grid.get_spheres().get_center(grid.get_index(0))[0] == 0.95);
+  REQUIRE(grid.get_spheres().velocity(grid.get_index(2), 1) == 1);
+
+  // the cell lists follow the new indices
+  std::vector<int> nearby = grid.get_nearby_spheres(grid.get_index(1));
+  std::sort(nearby.begin(), nearby.end());
+  REQUIRE(nearby == std::vector<int>{0, 1, 2});
+
+  // already sorted
+  REQUIRE(grid.reorder() == std::vector<int>{0, 1, 2});
+  REQUIRE(grid.get_index(0) == 2);
+}
+
+TEST_CASE("Spatial Grid Sectors") {
+  Sphere *spheres = new Sphere[4];
+  spheres[0] = Sphere(0.01, point3(0.05, 0.05, 0.05), vec3(0, 0, 0));
+  spheres[1] = Sphere(0.01, point3(0.25, 0.05, 0.05), vec3(1, 0, 0));
+  spheres[2] = Sphere(0.01, point3(0.55, 0.05, 0.05), vec3(0, 0, 0));
+  spheres[3] = Sphere(0.01, point3(0.95, 0.05, 0.05), vec3(0, 0, 0));
+  SpatialGrid grid(0.1, 10, 4, spheres);
+  REQUIRE(grid.get_sector_count() == 1);
+  REQUIRE(grid.in_sector_interior(0, 1));
+
+  // sectors are at least three columns wide
+  REQUIRE(grid.set_sector_count(10) == 3);
+  REQUIRE(grid.set_sector_count(2) == 2);
+  REQUIRE(grid.get_sector(0) == 0);
+  REQUIRE(grid.get_sector(1) == 0);
+  REQUIRE(grid.get_sector(2) == 1);
+  REQUIRE(grid.get_sector(3) == 1);
+  REQUIRE(grid.get_occupied_cell_count() == 4);
+
+  // columns 0 and 4 are the borders of the first sector
+  REQUIRE(!grid.in_sector_interior(0));
+  REQUIRE(grid.in_sector_interior(1, 1));
+  REQUIRE(!grid.in_sector_interior(1, 2));
+
+  // neighbours are still found across the sectors
+  std::vector<int> nearby = grid.get_nearby_spheres(0);
+  std::sort(nearby.begin(), nearby.end());
+  REQUIRE(nearby == std::vector<int>{0, 3});
+
+  // a sphere put back goes back into its old cell
+  SpatialGrid::SphereState saved = grid.save_sphere(1);
+  grid.advance_sphere(1, grid.time_to_transfer(1));
+  grid.transfer_sphere(1);
+  REQUIRE(grid.get_spheres().time(1) > 0);
+  grid.restore_sphere(1, saved);
+  REQUIRE(grid.get_spheres().time(1) == 0);
+  REQUIRE(grid.get_spheres().get_center(1)[0] == 0.25);
+  REQUIRE(grid.get_nearby_spheres(1) == std::vector<int>{1});
+  REQUIRE(grid.get_occupied_cell_count() == 4);
+}
+
+TEST_CASE("Spatial Grid Sparse Cells") {
+  // a dense 1000^3 grid would need 10^9 cells
+  SpatialGrid grid(0.001, 1000, 100, 0.0005);
+  REQUIRE(grid.get_occupied_cell_count() > 0);
+  REQUIRE(grid.get_occupied_cell_count() <= 100);
+}
+
+TEST_CASE("Spatial Grid Stencil") {
+  constexpr auto stencil = make_stencil<3>();
+  REQUIRE(stencil.size() == 27);
+  REQUIRE(stencil[0] == std::array<int, 3>{-1, -1, -1});
+  REQUIRE(stencil[13] == std::array<int, 3>{0, 0, 0});
+  REQUIRE(stencil[26] == std::array<int, 3>{1, 1, 1});
+  REQUIRE(make_stencil<2>().size() == 9);
+  REQUIRE(make_stencil<4>().size() == 81);
+}
@@ -2,6 +2,7 @@
 
 #include <catch2/catch_test_macros.hpp>
 
+#include "Event.h"
 #include "Sphere.h"
 #include "vec3.h"
 
@@ -53,6 +54,23 @@ TEST_CASE("Sphere Update Position", "[Sphere]") {
   REQUIRE(collide(&s2, &s3) == 0.0);
 }
 
+TEST_CASE("Sphere Advance To", "[Sphere]") {
+  Sphere s1(1, point3(0, 0, 0), vec3(1, 0, 0));
+  REQUIRE(s1.get_time() == 0);
+
+  s1.advance_to(0.5);
+  REQUIRE(s1.get_center() == point3(0.5, 0, 0));
+  REQUIRE(s1.get_time() == 0.5);
+
+  // advancing to the current local time is a no-op
+  s1.advance_to(0.5);
+  REQUIRE(s1.get_center() == point3(0.5, 0, 0));
+
+  s1.update_position(0.5);
+  REQUIRE(s1.get_time() == 1.0);
+  REQUIRE(s1.get_center() == point3(1, 0, 0));
+}
+
 TEST_CASE("Sphere Collision Velocity", "[Sphere]") {
   // moving towards each other
   Sphere s1(1, point3(0, 0, 0), vec3(1, 0, 0));
@@ -77,4 +95,29 @@ TEST_CASE("Sphere Collision Velocity", "[Sphere]") {
   resolve_collision(&s5, &s6);
   REQUIRE(s5.get_velocity() == vec3(0, 0, 0));
   REQUIRE(s6.get_velocity() == vec3(0, 0, 0));
-}
\ No newline at end of file
+}
+
+TEST_CASE("Sphere Collision Counter", "[Sphere]") {
+  Sphere s[3] = {Sphere(1, point3(0, 0, 0), vec3(1, 0, 0)),
+                 Sphere(1, point3(2, 0, 0), vec3(-1, 0, 0)),
+                 Sphere(1, point3(5, 0, 0), vec3(-1, 0, 0))};
+  auto collision_count = [&](int i) { return s[i].get_collision_count(); };
+  REQUIRE(s[0].get_collision_count() == 0);
+
+  Event e01(0, 0, 1, s[0].get_collision_count(), s[1].get_collision_count());
+  Event e02(2, 0, 2, s[0].get_collision_count(), s[2].get_collision_count());
+  REQUIRE(!e01.is_stale(collision_count));
+  REQUIRE(!e02.is_stale(collision_count));
+
+  resolve_collision(&s[0], &s[1]);
+  REQUIRE(s[0].get_collision_count() == 1);
+  REQUIRE(s[1].get_collision_count() == 1);
+  REQUIRE(s[2].get_collision_count() == 0);
+
+  // both events were predicted before s[0] collided
+  REQUIRE(e01.is_stale(collision_count));
+  REQUIRE(e02.is_stale(collision_count));
+  REQUIRE(!Event(1, 1, 2, s[1].get_collision_count(),
+                 s[2].get_collision_count())
+               .is_stale(collision_count));
+}
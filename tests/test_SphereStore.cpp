@@ -0,0 +1,73 @@
+#define CATCH_CONFIG_MAIN
+
+#include <cmath>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "Sphere.h"
+#include "SphereStore.h"
+
+TEST_CASE("Sphere Store Round Trip", "[SphereStore]") {
+  Sphere spheres[2] = {Sphere(0.1, point3(0.1, 0.2, 0.3), vec3(1, 0, 0)),
+                       Sphere(0.1, point3(0.4, 0.5, 0.6), vec3(0, 1, 0))};
+  spheres[1].set_time(0.5);
+  SphereStore store(2, spheres, 1.0);
+
+  REQUIRE(store.size() == 2);
+  REQUIRE(store.center(1, 2) == spheres[1].get_center()[2]);
+  REQUIRE(store.velocity(0, 0) == 1);
+  REQUIRE(store.time(1) == 0.5);
+  REQUIRE(store.radius(1) == 0.1);
+
+  Sphere s = store.get_sphere(1);
+  REQUIRE(s == spheres[1]);
+  REQUIRE(s.get_center() == spheres[1].get_center());
+  REQUIRE(s.get_time() == 0.5);
+
+  store.advance_to(0, 0.25);
+  REQUIRE(store.get_center(0).isApprox(point3(0.35, 0.2, 0.3)));
+  REQUIRE(store.time(0) == 0.25);
+}
+
+TEST_CASE("Sphere Store Mixed Radii", "[SphereStore]") {
+  Sphere spheres[2] = {Sphere(0.1, point3(0, 0, 0), vec3(0, 0, 0)),
+                       Sphere(0.2, point3(0, 0, 0), vec3(0, 0, 0))};
+  SphereStore store(2, spheres, 1.0);
+  REQUIRE(store.radius(0) == 0.1);
+  REQUIRE(store.radius(1) == 0.2);
+}
+
+TEST_CASE("Sphere Store Collide", "[SphereStore]") {
+  // the same head on collision the Sphere collide tests use
+  Sphere spheres[2] = {Sphere(1, point3(0, 0, 0), vec3(1, 0, 0)),
+                       Sphere(1, point3(3, 0, 0), vec3(-1, 0, 0))};
+  SphereStore store(2, spheres, 0);
+  REQUIRE(collide(store, 0, 1) == collide(&spheres[0], &spheres[1]));
+  REQUIRE(std::abs(collide(store, 0, 1) - 0.5) < 1e-12);
+
+  // the earlier sphere is projected forward without being moved
+  store.time(1) = -0.25;
+  REQUIRE(std::abs(collide(store, 0, 1) - 0.375) < 1e-12);
+  REQUIRE(store.time(1) == -0.25);
+
+  store.advance_to(0, 0.5);
+  store.advance_to(1, 0.5);
+  resolve_collision(store, 0, 1);
+  REQUIRE(store.get_velocity(0).isApprox(vec3(-1, 0, 0)));
+  REQUIRE(store.get_velocity(1).isApprox(vec3(1, 0, 0)));
+  REQUIRE(store.collision_count(0) == 1);
+  REQUIRE(store.collision_count(1) == 1);
+}
+
+TEST_CASE("Sphere Store Collide Across Boundary", "[SphereStore]") {
+  Sphere spheres[2] = {Sphere(0.05, point3(0.95, 0.5, 0.5), vec3(1, 0, 0)),
+                       Sphere(0.05, point3(0.1, 0.5, 0.5), vec3(0, 0, 0))};
+  SphereStore store(2, spheres, 1.0);
+  REQUIRE(std::abs(collide(store, 0, 1) - 0.05) < 1e-12);
+
+  store.advance_to(0, 0.05);
+  store.advance_to(1, 0.05);
+  resolve_collision(store, 0, 1);
+  REQUIRE(store.get_velocity(0).isApprox(vec3(0, 0, 0)));
+  REQUIRE(store.get_velocity(1).isApprox(vec3(1, 0, 0)));
+}
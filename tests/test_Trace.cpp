@@ -0,0 +1,107 @@
+#define CATCH_CONFIG_MAIN
+
+#include <sstream>
+#include <string>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "EventDrivenSimulation.h"
+#include "Trace.h"
+#include "parallel.h"
+
+namespace {
+
+int count(const std::string &text, const std::string &pattern) {
+  int found = 0;
+  for (size_t at = text.find(pattern); at != std::string::npos;
+       at = text.find(pattern, at + 1)) {
+    found++;
+  }
+  return found;
+}
+
+std::string trace_json() {
+  std::ostringstream out;
+  Tracer::get().write_json(out);
+  return out.str();
+}
+
+} // namespace
+
+TEST_CASE("Trace Scopes") {
+  Tracer &tracer = Tracer::get();
+  tracer.stop();
+  { TraceScope scope("ignored"); }
+
+  tracer.start();
+  REQUIRE(tracer.size() == 0);
+  {
+    TraceScope outer("outer");
+    TraceScope inner("inner");
+  }
+  tracer.stop();
+  { TraceScope scope("ignored"); }
+
+  REQUIRE(tracer.size() == 2);
+  std::string json = trace_json();
+  REQUIRE(count(json, "\"ph\": \"X\"") == 2);
+  REQUIRE(count(json, "\"name\": \"outer\"") == 1);
+  REQUIRE(count(json, "\"name\": \"inner\"") == 1);
+  REQUIRE(count(json, "ignored") == 0);
+}
+
+TEST_CASE("Trace Sampling") {
+  Tracer &tracer = Tracer::get();
+  tracer.start(4);
+  for (int i = 0; i < 8; i++) {
+    TraceScope phase("phase", false);
+    TraceScope outer("outer");
+    TraceScope inner("inner");
+  }
+  tracer.stop();
+
+  // phases are all kept, scopes nested in a sampled one go with it
+  std::string json = trace_json();
+  REQUIRE(count(json, "\"name\": \"phase\"") == 8);
+  REQUIRE(count(json, "\"name\": \"outer\"") == 2);
+  REQUIRE(count(json, "\"name\": \"inner\"") == 2);
+}
+
+TEST_CASE("Trace Threads") {
+  Tracer &tracer = Tracer::get();
+  tracer.start();
+  for (int round = 0; round < 3; round++) {
+    parallel_for(3, 3, [](int, int, int) { TraceScope scope("round"); });
+  }
+  tracer.stop();
+
+  // every round starts new threads, which take over the tracks of the last.
+  // there are never more tracks than threads running at once
+  std::string json = trace_json();
+  REQUIRE(count(json, "\"name\": \"round\"") == 9);
+  REQUIRE(count(json, "thread_name") <= 3);
+}
+
+#if COLLECT_TRACE
+TEST_CASE("Trace Event Driven Sim") {
+  EventDrivenSimulation sim(QueueType::HEAP);
+  sim.reset(500, 12);
+
+  Tracer &tracer = Tracer::get();
+  tracer.start(10);
+  sim.initialize_events();
+  sim.run_simulation();
+  tracer.stop();
+
+  std::string json = trace_json();
+  for (const char *name :
+       {"initialize_events", "run_simulation", "queue_pop", "handle_event",
+        "gather_neighbors", "collide", "resolve_collision", "advance_sphere"}) {
+    REQUIRE(json.find("\"name\": \"" + std::string(name) + "\"") !=
+            std::string::npos);
+  }
+  // one in ten events
+  REQUIRE(count(json, "\"name\": \"event\"") <=
+          sim.get_event_count() / 10 + 1);
+}
+#endif
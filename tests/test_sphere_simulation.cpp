@@ -154,6 +154,8 @@ TEST_CASE("Sphere Sim Billiards Collision Detection") {
   sim1.run_simulation();
 
   REQUIRE(sim1.get_collision_times().size() == 1);
+  // the (1, 2) event was invalidated by the (0, 1) collision
+  REQUIRE(sim1.get_stale_event_count() >= 1);
 
   REQUIRE(spheres[0].get_max_collision_checks() == 0);
   REQUIRE(spheres[1].get_max_collision_checks() == 0);
@@ -168,4 +170,36 @@ TEST_CASE("Sphere Sim Billiards Collision Detection") {
   REQUIRE(spheres[2].get_velocity().isApprox(vec3(-2, 0, 0)));
 
 
-}
\ No newline at end of file
+}
+
+TEST_CASE("Sphere Sim Calendar Queue") {
+  Sphere* spheres = new Sphere[3];
+  spheres[0] = Sphere(0.05, point3(0.1, 0.5, 0.5), vec3(2.0, 0, 0));
+  spheres[1] = Sphere(0.05, point3(0.5, 0.5, 0.5), vec3(0, 0, 0));
+  spheres[2] = Sphere(0.05, point3(1.0, 0.5, 0.5), vec3(-2.0, 0, 0));
+
+  sphere_simulation sim(3, spheres, QueueType::CALENDAR);
+
+  sim.initialize_events();
+  sim.run_simulation();
+
+  REQUIRE(sim.get_collision_times().size() == 1);
+  REQUIRE(spheres[0].get_center().isApprox(point3(0.4, 0.5, 0.5)));
+  REQUIRE(spheres[1].get_center().isApprox(point3(0.2, 0.5, 0.5)));
+  REQUIRE(spheres[2].get_center().isApprox(point3(0.0, 0.5, 0.5)));
+}
+
+TEST_CASE("Sphere Sim Seeded Threads") {
+  // spheres and their ids come out the same however many threads draw them
+  sphere_simulation serial(500, 12, QueueType::HEAP, 1);
+  sphere_simulation threaded(500, 12, QueueType::HEAP, 4);
+
+  REQUIRE(threaded.get_number_of_spheres() == serial.get_number_of_spheres());
+  for (int i = 0; i < serial.get_number_of_spheres(); i++) {
+    const Sphere &sphere = serial.get_spheres()[i];
+    REQUIRE(sphere.get_id() == i);
+    REQUIRE(threaded.get_spheres()[i].get_id() == i);
+    REQUIRE(threaded.get_spheres()[i].get_center() == sphere.get_center());
+    REQUIRE(threaded.get_spheres()[i].get_velocity() == sphere.get_velocity());
+  }
+}